@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Contiguous array that either owns its elements or borrows them from memory owned elsewhere,
+// e.g. a mapped database file. Borrowed elements are read-only: GetOwned copies them first
+template <typename T>
+class ArrayStorage {
+public:
+
+	static_assert(std::is_trivially_copyable_v<T>, "Only plain data can be borrowed from raw memory");
+
+	ArrayStorage() = default;
+	ArrayStorage(std::vector<T> elements)
+		: elements_(std::move(elements)) {
+	}
+	ArrayStorage(size_t count, const T& value)
+		: elements_(count, value) {
+	}
+
+	// The memory has to outlive the storage and every copy of it
+	static ArrayStorage Borrow(const T* data, size_t size) {
+		ArrayStorage storage;
+		storage.borrowed_data_ = data;
+		storage.borrowed_size_ = size;
+		return storage;
+	}
+
+	bool IsBorrowed() const {
+		return borrowed_data_ != nullptr;
+	}
+
+	const T* GetData() const {
+		return IsBorrowed() ? borrowed_data_ : elements_.data();
+	}
+
+	size_t GetSize() const {
+		return IsBorrowed() ? borrowed_size_ : elements_.size();
+	}
+
+	bool IsEmpty() const {
+		return GetSize() == 0;
+	}
+
+	const T& operator[](size_t index) const {
+		return GetData()[index];
+	}
+
+	const T* begin() const {
+		return GetData();
+	}
+
+	const T* end() const {
+		return GetData() + GetSize();
+	}
+
+	std::vector<T>& GetOwned() {
+		if (IsBorrowed()) {
+			elements_.assign(borrowed_data_, borrowed_data_ + borrowed_size_);
+			borrowed_data_ = nullptr;
+			borrowed_size_ = 0;
+		}
+		return elements_;
+	}
+
+private:
+
+	std::vector<T> elements_;
+	const T* borrowed_data_ = nullptr;
+	size_t borrowed_size_ = 0;
+
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Bidirectional A*: a forward search from `from` and a backward search from `to`, both guided by lower bounds
+// of the route weight. The searches use opposite halves of one potential, so they see the same reduced edge
+// weights and stop as soon as their queue tops together reach the best route met so far.
+// The bound of a vertex pair is the largest of the given bound (e.g. a geographic one) and the ALT bounds
+// of the landmarks. The given bound has to be consistent: bound(u, w) <= weight(u, v) + bound(v, w)
+template <typename Weight>
+class BidirectionalAStarRouter {
+private:
+
+    using Graph = DirectedWeightedGraph<Weight>;
+    using Traits = WeightTraits<Weight>;
+
+public:
+
+    using Comparable = typename Traits::Comparable;
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using PackedEdgeId = typename Router<Weight>::PackedEdgeId;
+    using LowerBound = std::function<Comparable(VertexId from, VertexId to)>;
+
+    static constexpr PackedEdgeId NO_EDGE = Router<Weight>::NO_EDGE;
+    static constexpr Comparable INFINITE_WEIGHT = Router<Weight>::INFINITE_WEIGHT;
+
+    // Route weights from every landmark and to every landmark, a row of vertex_count values per landmark.
+    // Unreachable vertices hold INFINITE_WEIGHT
+    struct Landmarks {
+        std::vector<VertexId> vertices;
+        std::vector<Comparable> weights_from;
+        std::vector<Comparable> weights_to;
+    };
+
+    // Farthest-first choice: every next landmark is the vertex farthest from the landmarks chosen so far
+    static Landmarks SelectLandmarks(const Graph& graph, size_t count);
+
+    BidirectionalAStarRouter(const Graph& graph, LowerBound lower_bound, Landmarks landmarks = {});
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    // Vertices taken from the queues by all the queries so far, a measure of the search space
+    size_t GetSettledVertexCount() const {
+        return settled_vertex_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    using QueueItem = std::pair<Comparable, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    const Graph* graph_ = nullptr;
+    LowerBound lower_bound_;
+    Landmarks landmarks_;
+    mutable std::atomic<size_t> settled_vertex_count_ = 0;
+
+    // One-to-all Dijkstra along the edges or, when is_backward, against them
+    static std::vector<Comparable> ComputeWeights(const Graph& graph, VertexId source, bool is_backward);
+
+    Comparable GetLowerBound(VertexId from, VertexId to) const;
+
+};
+
+template <typename Weight>
+BidirectionalAStarRouter<Weight>::BidirectionalAStarRouter(const Graph& graph, LowerBound lower_bound, Landmarks landmarks)
+    : graph_(&graph)
+    , lower_bound_(std::move(lower_bound))
+    , landmarks_(std::move(landmarks))
+{
+    if (graph.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for the A* router");
+    }
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (Traits::ToComparable(graph.GetEdge(edge_id).weight) < Comparable{}) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+    const size_t row_count = landmarks_.vertices.size() * graph.GetVertexCount();
+    if (landmarks_.weights_from.size() != row_count || landmarks_.weights_to.size() != row_count) {
+        throw std::invalid_argument("Landmark weights don't match the graph");
+    }
+}
+
+template <typename Weight>
+std::vector<typename BidirectionalAStarRouter<Weight>::Comparable> BidirectionalAStarRouter<Weight>::ComputeWeights(
+    const Graph& graph, VertexId source, bool is_backward) {
+    std::vector<Comparable> weights(graph.GetVertexCount(), INFINITE_WEIGHT);
+    Queue queue;
+    weights[source] = Comparable{};
+    queue.push({Comparable{}, source});
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > weights[vertex]) {
+            continue;
+        }
+        const auto relax = [&](EdgeId edge_id) {
+            const auto& edge = graph.GetEdge(edge_id);
+            const VertexId next = is_backward ? edge.from : edge.to;
+            const Comparable candidate = weight + Traits::ToComparable(edge.weight);
+            if (candidate < weights[next]) {
+                weights[next] = candidate;
+                queue.push({candidate, next});
+            }
+        };
+        if (is_backward) {
+            for (const EdgeId edge_id : graph.GetIncomingEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+        else {
+            for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+    }
+    return weights;
+}
+
+template <typename Weight>
+typename BidirectionalAStarRouter<Weight>::Landmarks BidirectionalAStarRouter<Weight>::SelectLandmarks(const Graph& graph,
+                                                                                                       size_t count) {
+    Landmarks landmarks;
+    const size_t vertex_count = graph.GetVertexCount();
+    if (count == 0 || vertex_count == 0) {
+        return landmarks;
+    }
+    // Unreachable vertices can't be picked: a landmark gives them no bounds anyway
+    const auto find_farthest = [vertex_count](const std::vector<Comparable>& weights) {
+        std::optional<VertexId> farthest;
+        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+            if (weights[vertex] < INFINITE_WEIGHT && weights[vertex] > Comparable{}
+                && (!farthest || weights[vertex] > weights[*farthest])) {
+                farthest = vertex;
+            }
+        }
+        return farthest;
+    };
+
+    std::optional<VertexId> landmark = find_farthest(ComputeWeights(graph, 0, false)).value_or(0);
+    std::vector<Comparable> nearest_weights(vertex_count, INFINITE_WEIGHT);
+    while (landmark && landmarks.vertices.size() < count) {
+        landmarks.vertices.push_back(*landmark);
+        const auto weights_from = ComputeWeights(graph, *landmark, false);
+        const auto weights_to = ComputeWeights(graph, *landmark, true);
+        landmarks.weights_from.insert(landmarks.weights_from.end(), weights_from.begin(), weights_from.end());
+        landmarks.weights_to.insert(landmarks.weights_to.end(), weights_to.begin(), weights_to.end());
+        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+            nearest_weights[vertex] = std::min(nearest_weights[vertex], weights_from[vertex]);
+        }
+        landmark = find_farthest(nearest_weights);
+    }
+    return landmarks;
+}
+
+//Triangle inequality over every landmark, both ends have to be reached for a bound
+template <typename Weight>
+typename BidirectionalAStarRouter<Weight>::Comparable BidirectionalAStarRouter<Weight>::GetLowerBound(VertexId from,
+                                                                                                     VertexId to) const {
+    Comparable bound = std::max(Comparable{}, lower_bound_ ? lower_bound_(from, to) : Comparable{});
+    const size_t vertex_count = graph_->GetVertexCount();
+    for (size_t index = 0; index < landmarks_.vertices.size(); ++index) {
+        const Comparable* weights_from = landmarks_.weights_from.data() + index * vertex_count;
+        const Comparable* weights_to = landmarks_.weights_to.data() + index * vertex_count;
+        if (weights_from[from] < INFINITE_WEIGHT && weights_from[to] < INFINITE_WEIGHT) {
+            bound = std::max(bound, weights_from[to] - weights_from[from]);
+        }
+        if (weights_to[from] < INFINITE_WEIGHT && weights_to[to] < INFINITE_WEIGHT) {
+            bound = std::max(bound, weights_to[from] - weights_to[to]);
+        }
+    }
+    return bound;
+}
+
+template <typename Weight>
+std::optional<typename BidirectionalAStarRouter<Weight>::RouteInfo> BidirectionalAStarRouter<Weight>::BuildRoute(VertexId from,
+                                                                                                                 VertexId to) const {
+    const size_t vertex_count = graph_->GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    // Forward potential of a vertex, the backward search uses its negation
+    std::vector<std::optional<Comparable>> potentials(vertex_count);
+    const auto get_potential = [&](size_t direction, VertexId vertex) {
+        auto& potential = potentials[vertex];
+        if (!potential) {
+            potential = (GetLowerBound(vertex, to) - GetLowerBound(from, vertex)) / 2;
+        }
+        return direction == 0 ? *potential : -*potential;
+    };
+
+    // Index 0 is the forward search from `from`, index 1 the backward search from `to`
+    std::vector<Comparable> weights[2] = {std::vector<Comparable>(vertex_count, INFINITE_WEIGHT),
+                                          std::vector<Comparable>(vertex_count, INFINITE_WEIGHT)};
+    std::vector<PackedEdgeId> parent_edges[2] = {std::vector<PackedEdgeId>(vertex_count, NO_EDGE),
+                                                 std::vector<PackedEdgeId>(vertex_count, NO_EDGE)};
+    Queue queues[2];
+    weights[0][from] = Comparable{};
+    weights[1][to] = Comparable{};
+    queues[0].push({get_potential(0, from), from});
+    queues[1].push({get_potential(1, to), to});
+
+    Comparable best_weight = from == to ? Comparable{} : INFINITE_WEIGHT;
+    std::optional<VertexId> meeting_vertex;
+    if (from == to) {
+        meeting_vertex = from;
+    }
+    size_t settled_vertex_count = 0;
+    while (!queues[0].empty() && !queues[1].empty()
+           && queues[0].top().first + queues[1].top().first < best_weight) {
+        const size_t direction = queues[0].top().first <= queues[1].top().first ? 0 : 1;
+        const auto [key, vertex] = queues[direction].top();
+        queues[direction].pop();
+        const Comparable weight = weights[direction][vertex];
+        if (key > weight + get_potential(direction, vertex)) {
+            continue;
+        }
+        ++settled_vertex_count;
+        const auto relax = [&](EdgeId edge_id) {
+            const auto& edge = graph_->GetEdge(edge_id);
+            const VertexId next = direction == 0 ? edge.to : edge.from;
+            const Comparable candidate = weight + Traits::ToComparable(edge.weight);
+            if (!(candidate < weights[direction][next])) {
+                return;
+            }
+            weights[direction][next] = candidate;
+            parent_edges[direction][next] = static_cast<PackedEdgeId>(edge_id);
+            queues[direction].push({candidate + get_potential(direction, next), next});
+            const Comparable total_weight = candidate + weights[1 - direction][next];
+            if (total_weight < best_weight) {
+                best_weight = total_weight;
+                meeting_vertex = next;
+            }
+        };
+        if (direction == 0) {
+            for (const EdgeId edge_id : graph_->GetIncidentEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+        else {
+            for (const EdgeId edge_id : graph_->GetIncomingEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+    }
+    settled_vertex_count_.fetch_add(settled_vertex_count, std::memory_order_relaxed);
+    if (!meeting_vertex) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (VertexId vertex = *meeting_vertex; parent_edges[0][vertex] != NO_EDGE; vertex = graph_->GetEdge(parent_edges[0][vertex]).from) {
+        edges.push_back(parent_edges[0][vertex]);
+    }
+    std::reverse(edges.begin(), edges.end());
+    for (VertexId vertex = *meeting_vertex; parent_edges[1][vertex] != NO_EDGE; vertex = graph_->GetEdge(parent_edges[1][vertex]).to) {
+        edges.push_back(parent_edges[1][vertex]);
+    }
+
+    return RouteInfo{Traits::FromComparable(best_weight), std::move(edges)};
+}
+
+}  // namespace graph
@@ -0,0 +1,427 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Contraction Hierarchies: vertices are contracted one by one in order of importance, shortcuts keep
+// the distances between the remaining ones. A query is a bidirectional Dijkstra that only climbs in rank
+template <typename Weight>
+class ContractionHierarchy {
+private:
+
+    using Graph = DirectedWeightedGraph<Weight>;
+    using Traits = WeightTraits<Weight>;
+
+public:
+
+    using Comparable = typename Traits::Comparable;
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+    using PackedEdgeId = uint32_t;
+
+    static constexpr PackedEdgeId NO_EDGE = Router<Weight>::NO_EDGE;
+
+    // Edge of the hierarchy: an edge of the original graph, or a shortcut replacing two hierarchy edges
+    struct HierarchyEdge {
+        VertexId from;
+        VertexId to;
+        Comparable weight;
+        PackedEdgeId original_edge = NO_EDGE;
+        PackedEdgeId first_half = NO_EDGE;
+        PackedEdgeId second_half = NO_EDGE;
+
+        bool IsShortcut() const {
+            return original_edge == NO_EDGE;
+        }
+    };
+
+    ContractionHierarchy() = default;
+    explicit ContractionHierarchy(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    void SetGraph(const Graph& graph) {
+        graph_ = &graph;
+    }
+
+    // Restores a hierarchy built earlier, e.g. one read from the database
+    void SetHierarchy(std::vector<uint32_t> ranks, std::vector<HierarchyEdge> edges);
+
+    const std::vector<uint32_t>& GetRanks() const {
+        return ranks_;
+    }
+
+    const std::vector<HierarchyEdge>& GetEdges() const {
+        return edges_;
+    }
+
+private:
+
+    // Vertex budget of a witness search when a contraction is simulated and when it is performed
+    static constexpr size_t SIMULATION_SETTLE_LIMIT = 64;
+    static constexpr size_t CONTRACTION_SETTLE_LIMIT = 1024;
+    static constexpr Comparable INFINITE_WEIGHT = Traits::Infinity();
+
+    // Edge between two not yet contracted vertices during preprocessing
+    struct Arc {
+        VertexId target;
+        Comparable weight;
+        PackedEdgeId original_edge;
+        PackedEdgeId first_half;
+        PackedEdgeId second_half;
+    };
+
+    struct Shortcut {
+        VertexId from;
+        VertexId to;
+        Comparable weight;
+        size_t in_arc;
+        size_t out_arc;
+    };
+
+    using QueueItem = std::pair<Comparable, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    // Upward search graph in CSR form: for every vertex the hierarchy edges leading to higher-ranked
+    // vertices (forward search) and the hierarchy edges coming from higher-ranked vertices (backward search)
+    struct SearchGraph {
+        std::vector<size_t> offsets;
+        std::vector<PackedEdgeId> edges;
+    };
+
+    // Preprocessing state, dropped once the hierarchy is built
+    struct Contraction {
+        std::vector<std::vector<Arc>> out_arcs;
+        std::vector<std::vector<Arc>> in_arcs;
+        std::vector<bool> is_contracted;
+        std::vector<int> contracted_neighbours;
+        std::vector<Comparable> witness_weights;
+        std::vector<VertexId> witness_touched;
+    };
+
+    // Witness search from `from` avoiding `skipped`, stops once every target is settled or beyond max_weight
+    static void FindWitnesses(Contraction& contraction, VertexId from, VertexId skipped,
+                              Comparable max_weight, size_t settle_limit) {
+        for (const VertexId vertex : contraction.witness_touched) {
+            contraction.witness_weights[vertex] = INFINITE_WEIGHT;
+        }
+        contraction.witness_touched.clear();
+        Queue queue;
+        contraction.witness_weights[from] = Comparable{};
+        contraction.witness_touched.push_back(from);
+        queue.push({Comparable{}, from});
+        size_t settled = 0;
+        while (!queue.empty() && settled < settle_limit) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > contraction.witness_weights[vertex]) {
+                continue;
+            }
+            if (weight > max_weight) {
+                break;
+            }
+            ++settled;
+            for (const Arc& arc : contraction.out_arcs[vertex]) {
+                if (arc.target == skipped) {
+                    continue;
+                }
+                const Comparable candidate = weight + arc.weight;
+                Comparable& target_weight = contraction.witness_weights[arc.target];
+                if (candidate < target_weight) {
+                    if (target_weight == INFINITE_WEIGHT) {
+                        contraction.witness_touched.push_back(arc.target);
+                    }
+                    target_weight = candidate;
+                    queue.push({candidate, arc.target});
+                }
+            }
+        }
+    }
+
+    // Shortcuts that contracting the vertex would add: in-arc/out-arc pairs with no witness path
+    static std::vector<Shortcut> FindShortcuts(Contraction& contraction, VertexId vertex, size_t settle_limit) {
+        std::vector<Shortcut> shortcuts;
+        const auto& in_arcs = contraction.in_arcs[vertex];
+        const auto& out_arcs = contraction.out_arcs[vertex];
+        if (out_arcs.empty()) {
+            return shortcuts;
+        }
+        Comparable max_out_weight{};
+        for (const Arc& out_arc : out_arcs) {
+            max_out_weight = std::max(max_out_weight, out_arc.weight);
+        }
+        for (size_t in_index = 0; in_index < in_arcs.size(); ++in_index) {
+            const Arc& in_arc = in_arcs[in_index];
+            FindWitnesses(contraction, in_arc.target, vertex, in_arc.weight + max_out_weight, settle_limit);
+            for (size_t out_index = 0; out_index < out_arcs.size(); ++out_index) {
+                const Arc& out_arc = out_arcs[out_index];
+                if (out_arc.target == in_arc.target) {
+                    continue;
+                }
+                const Comparable weight = in_arc.weight + out_arc.weight;
+                if (contraction.witness_weights[out_arc.target] > weight) {
+                    shortcuts.push_back({in_arc.target, out_arc.target, weight, in_index, out_index});
+                }
+            }
+        }
+        return shortcuts;
+    }
+
+    // Edge difference plus the number of already contracted neighbours, smaller goes first
+    static int GetPriority(Contraction& contraction, VertexId vertex) {
+        const int shortcut_count = static_cast<int>(FindShortcuts(contraction, vertex, SIMULATION_SETTLE_LIMIT).size());
+        const int removed_count = static_cast<int>(contraction.in_arcs[vertex].size() + contraction.out_arcs[vertex].size());
+        return shortcut_count - removed_count + contraction.contracted_neighbours[vertex];
+    }
+
+    // Keeps the lighter of an existing arc and a new one between the same vertices
+    static void AddArc(Contraction& contraction, VertexId from, const Arc& arc) {
+        auto& out_arcs = contraction.out_arcs[from];
+        const auto out_it = std::find_if(out_arcs.begin(), out_arcs.end(),
+                                         [&arc](const Arc& other) { return other.target == arc.target; });
+        Arc in_arc = arc;
+        in_arc.target = from;
+        if (out_it == out_arcs.end()) {
+            out_arcs.push_back(arc);
+            contraction.in_arcs[arc.target].push_back(in_arc);
+            return;
+        }
+        if (!(arc.weight < out_it->weight)) {
+            return;
+        }
+        *out_it = arc;
+        auto& in_arcs = contraction.in_arcs[arc.target];
+        *std::find_if(in_arcs.begin(), in_arcs.end(),
+                      [from](const Arc& other) { return other.target == from; }) = in_arc;
+    }
+
+    static void RemoveArc(std::vector<Arc>& arcs, VertexId target) {
+        arcs.erase(std::find_if(arcs.begin(), arcs.end(),
+                                [target](const Arc& arc) { return arc.target == target; }));
+    }
+
+    // Moves the arcs of the vertex into the hierarchy and links its neighbours with the needed shortcuts
+    void ContractVertex(Contraction& contraction, VertexId vertex) {
+        const std::vector<Shortcut> shortcuts = FindShortcuts(contraction, vertex, CONTRACTION_SETTLE_LIMIT);
+        auto in_arcs = std::move(contraction.in_arcs[vertex]);
+        auto out_arcs = std::move(contraction.out_arcs[vertex]);
+        contraction.in_arcs[vertex].clear();
+        contraction.out_arcs[vertex].clear();
+        contraction.is_contracted[vertex] = true;
+
+        std::vector<PackedEdgeId> in_edges;
+        for (const Arc& arc : in_arcs) {
+            in_edges.push_back(AddHierarchyEdge(arc.target, vertex, arc));
+            RemoveArc(contraction.out_arcs[arc.target], vertex);
+            ++contraction.contracted_neighbours[arc.target];
+        }
+        std::vector<PackedEdgeId> out_edges;
+        for (const Arc& arc : out_arcs) {
+            out_edges.push_back(AddHierarchyEdge(vertex, arc.target, arc));
+            RemoveArc(contraction.in_arcs[arc.target], vertex);
+            ++contraction.contracted_neighbours[arc.target];
+        }
+        for (const Shortcut& shortcut : shortcuts) {
+            AddArc(contraction, shortcut.from,
+                   Arc{shortcut.to, shortcut.weight, NO_EDGE, in_edges[shortcut.in_arc], out_edges[shortcut.out_arc]});
+        }
+    }
+
+    PackedEdgeId AddHierarchyEdge(VertexId from, VertexId to, const Arc& arc) {
+        edges_.push_back({from, to, arc.weight, arc.original_edge, arc.first_half, arc.second_half});
+        return static_cast<PackedEdgeId>(edges_.size() - 1);
+    }
+
+    void BuildSearchGraphs() {
+        const size_t vertex_count = ranks_.size();
+        up_graph_.offsets.assign(vertex_count + 1, 0);
+        down_graph_.offsets.assign(vertex_count + 1, 0);
+        for (const auto& edge : edges_) {
+            if (ranks_[edge.from] < ranks_[edge.to]) {
+                ++up_graph_.offsets[edge.from + 1];
+            }
+            else {
+                ++down_graph_.offsets[edge.to + 1];
+            }
+        }
+        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+            up_graph_.offsets[vertex + 1] += up_graph_.offsets[vertex];
+            down_graph_.offsets[vertex + 1] += down_graph_.offsets[vertex];
+        }
+        up_graph_.edges.resize(up_graph_.offsets.back());
+        down_graph_.edges.resize(down_graph_.offsets.back());
+        std::vector<size_t> up_positions(up_graph_.offsets.begin(), up_graph_.offsets.end() - 1);
+        std::vector<size_t> down_positions(down_graph_.offsets.begin(), down_graph_.offsets.end() - 1);
+        for (PackedEdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+            const auto& edge = edges_[edge_id];
+            if (ranks_[edge.from] < ranks_[edge.to]) {
+                up_graph_.edges[up_positions[edge.from]++] = edge_id;
+            }
+            else {
+                down_graph_.edges[down_positions[edge.to]++] = edge_id;
+            }
+        }
+    }
+
+    // Expands hierarchy edges into the original graph edges they stand for, in path order
+    void UnpackEdge(PackedEdgeId edge_id, std::vector<EdgeId>& path) const {
+        std::vector<PackedEdgeId> stack{edge_id};
+        while (!stack.empty()) {
+            const auto& edge = edges_[stack.back()];
+            stack.pop_back();
+            if (edge.IsShortcut()) {
+                stack.push_back(edge.second_half);
+                stack.push_back(edge.first_half);
+            }
+            else {
+                path.push_back(edge.original_edge);
+            }
+        }
+    }
+
+    const Graph* graph_ = nullptr;
+    std::vector<uint32_t> ranks_;
+    std::vector<HierarchyEdge> edges_;
+    SearchGraph up_graph_;
+    SearchGraph down_graph_;
+
+};
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph)
+    : graph_(&graph)
+{
+    const size_t vertex_count = graph.GetVertexCount();
+    if (graph.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for the contraction hierarchy");
+    }
+    Contraction contraction{std::vector<std::vector<Arc>>(vertex_count),
+                            std::vector<std::vector<Arc>>(vertex_count),
+                            std::vector<bool>(vertex_count, false),
+                            std::vector<int>(vertex_count, 0),
+                            std::vector<Comparable>(vertex_count, INFINITE_WEIGHT),
+                            {}};
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph.GetEdge(edge_id);
+        const Comparable weight = Traits::ToComparable(edge.weight);
+        if (weight < Comparable{}) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        if (edge.from != edge.to) {
+            AddArc(contraction, edge.from, Arc{edge.to, weight, static_cast<PackedEdgeId>(edge_id), NO_EDGE, NO_EDGE});
+        }
+    }
+
+    using PriorityItem = std::pair<int, VertexId>;
+    std::priority_queue<PriorityItem, std::vector<PriorityItem>, std::greater<PriorityItem>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        queue.push({GetPriority(contraction, vertex), vertex});
+    }
+    ranks_.assign(vertex_count, 0);
+    uint32_t rank = 0;
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+        // Lazy update: priorities of the neighbours change as the graph shrinks
+        const int priority = GetPriority(contraction, vertex);
+        if (!queue.empty() && priority > queue.top().first) {
+            queue.push({priority, vertex});
+            continue;
+        }
+        ContractVertex(contraction, vertex);
+        ranks_[vertex] = rank++;
+    }
+    BuildSearchGraphs();
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::SetHierarchy(std::vector<uint32_t> ranks, std::vector<HierarchyEdge> edges) {
+    ranks_ = std::move(ranks);
+    edges_ = std::move(edges);
+    BuildSearchGraphs();
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::RouteInfo> ContractionHierarchy<Weight>::BuildRoute(VertexId from,
+                                                                                                         VertexId to) const {
+    const size_t vertex_count = ranks_.size();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    // Index 0 is the forward search from `from`, index 1 the backward search from `to`
+    const SearchGraph* search_graphs[2] = {&up_graph_, &down_graph_};
+    std::vector<Comparable> weights[2] = {std::vector<Comparable>(vertex_count, INFINITE_WEIGHT),
+                                          std::vector<Comparable>(vertex_count, INFINITE_WEIGHT)};
+    std::vector<PackedEdgeId> parent_edges[2] = {std::vector<PackedEdgeId>(vertex_count, NO_EDGE),
+                                                 std::vector<PackedEdgeId>(vertex_count, NO_EDGE)};
+    Queue queues[2];
+    weights[0][from] = Comparable{};
+    weights[1][to] = Comparable{};
+    queues[0].push({Comparable{}, from});
+    queues[1].push({Comparable{}, to});
+
+    Comparable best_weight = INFINITE_WEIGHT;
+    std::optional<VertexId> meeting_vertex;
+    const auto is_finished = [&](size_t direction) {
+        return queues[direction].empty() || !(queues[direction].top().first < best_weight);
+    };
+    while (!is_finished(0) || !is_finished(1)) {
+        for (size_t direction = 0; direction < 2; ++direction) {
+            if (is_finished(direction)) {
+                continue;
+            }
+            const auto [weight, vertex] = queues[direction].top();
+            queues[direction].pop();
+            if (weight > weights[direction][vertex]) {
+                continue;
+            }
+            const Comparable total_weight = weight + weights[1 - direction][vertex];
+            if (total_weight < best_weight) {
+                best_weight = total_weight;
+                meeting_vertex = vertex;
+            }
+            const SearchGraph& search_graph = *search_graphs[direction];
+            for (size_t index = search_graph.offsets[vertex]; index < search_graph.offsets[vertex + 1]; ++index) {
+                const PackedEdgeId edge_id = search_graph.edges[index];
+                const auto& edge = edges_[edge_id];
+                const VertexId next = direction == 0 ? edge.to : edge.from;
+                const Comparable candidate = weight + edge.weight;
+                if (candidate < weights[direction][next]) {
+                    weights[direction][next] = candidate;
+                    parent_edges[direction][next] = edge_id;
+                    queues[direction].push({candidate, next});
+                }
+            }
+        }
+    }
+    if (!meeting_vertex) {
+        return std::nullopt;
+    }
+
+    std::vector<PackedEdgeId> forward_edges;
+    for (VertexId vertex = *meeting_vertex; parent_edges[0][vertex] != NO_EDGE; vertex = edges_[parent_edges[0][vertex]].from) {
+        forward_edges.push_back(parent_edges[0][vertex]);
+    }
+    std::reverse(forward_edges.begin(), forward_edges.end());
+    for (VertexId vertex = *meeting_vertex; parent_edges[1][vertex] != NO_EDGE; vertex = edges_[parent_edges[1][vertex]].to) {
+        forward_edges.push_back(parent_edges[1][vertex]);
+    }
+    std::vector<EdgeId> edges;
+    for (const PackedEdgeId edge_id : forward_edges) {
+        UnpackEdge(edge_id, edges);
+    }
+
+    return RouteInfo{Traits::FromComparable(best_weight), std::move(edges)};
+}
+
+}  // namespace graph
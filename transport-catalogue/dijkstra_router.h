@@ -0,0 +1,173 @@
+#pragma once
+
+#include "graph.h"
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Answers every query with its own Dijkstra search, so nothing but the graph has to be kept
+template <typename Weight>
+class DijkstraRouter {
+private:
+
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    // Shortest routes from one vertex: route weights of reachable vertices and the last edges of the routes
+    struct RoutesTree {
+        std::vector<std::optional<Weight>> weights;
+        std::vector<std::optional<EdgeId>> prev_edges;
+    };
+
+    DijkstraRouter() = default;
+    explicit DijkstraRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    RoutesTree BuildRoutesFrom(VertexId from) const;
+
+    // Routes from `from` no heavier than max_weight, vertices beyond it are left unreachable.
+    // With is_backward the routes lead to `from` over the transposed graph and prev_edges hold their next edges
+    RoutesTree BuildRoutesWithin(VertexId from, const Weight& max_weight, bool is_backward = false) const;
+
+    void SetGraph(const Graph& graph) {
+        graph_ = &graph;
+    }
+
+private:
+
+    using QueueItem = std::pair<Weight, VertexId>;
+
+    struct QueueItemGreater {
+        bool operator()(const QueueItem& lhs, const QueueItem& rhs) const {
+            return lhs.first > rhs.first;
+        }
+    };
+
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, QueueItemGreater>;
+
+    static inline Weight ZERO_WEIGHT{};
+    const Graph* graph_ = nullptr;
+
+    // Stops once `to` is settled or the queue minimum exceeds max_weight, searches the whole graph without them
+    RoutesTree Search(VertexId from, std::optional<VertexId> to,
+                      std::optional<Weight> max_weight = std::nullopt, bool is_backward = false) const;
+
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph)
+    : graph_(&graph)
+{
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (graph.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+typename DijkstraRouter<Weight>::RoutesTree DijkstraRouter<Weight>::Search(VertexId from,
+                                                                           std::optional<VertexId> to,
+                                                                           std::optional<Weight> max_weight,
+                                                                           bool is_backward) const {
+    const size_t vertex_count = graph_->GetVertexCount();
+    if (from >= vertex_count || (to && *to >= vertex_count)) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    RoutesTree tree{std::vector<std::optional<Weight>>(vertex_count), std::vector<std::optional<EdgeId>>(vertex_count)};
+    auto& weights = tree.weights;
+    auto& prev_edges = tree.prev_edges;
+    std::vector<bool> settled(vertex_count, false);
+    Queue queue;
+
+    weights[from] = ZERO_WEIGHT;
+    queue.push({ZERO_WEIGHT, from});
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+        if (settled[vertex]) {
+            continue;
+        }
+        if (max_weight && *weights[vertex] > *max_weight) {
+            break;
+        }
+        settled[vertex] = true;
+        if (vertex == to) {
+            break;
+        }
+        const auto relax = [&](EdgeId edge_id) {
+            const auto& edge = graph_->GetEdge(edge_id);
+            const VertexId next = is_backward ? edge.from : edge.to;
+            const Weight candidate_weight = *weights[vertex] + edge.weight;
+            auto& weight_to = weights[next];
+            if (!weight_to || candidate_weight < *weight_to) {
+                weight_to = candidate_weight;
+                prev_edges[next] = edge_id;
+                queue.push({candidate_weight, next});
+            }
+        };
+        if (is_backward) {
+            for (const EdgeId edge_id : graph_->GetIncomingEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+        else {
+            for (const EdgeId edge_id : graph_->GetIncidentEdges(vertex)) {
+                relax(edge_id);
+            }
+        }
+    }
+    if (max_weight) {
+        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+            if (!settled[vertex]) {
+                weights[vertex].reset();
+                prev_edges[vertex].reset();
+            }
+        }
+    }
+    return tree;
+}
+
+template <typename Weight>
+typename DijkstraRouter<Weight>::RoutesTree DijkstraRouter<Weight>::BuildRoutesFrom(VertexId from) const {
+    return Search(from, std::nullopt);
+}
+
+template <typename Weight>
+typename DijkstraRouter<Weight>::RoutesTree DijkstraRouter<Weight>::BuildRoutesWithin(VertexId from,
+                                                                                      const Weight& max_weight,
+                                                                                      bool is_backward) const {
+    return Search(from, std::nullopt, max_weight, is_backward);
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo> DijkstraRouter<Weight>::BuildRoute(VertexId from,
+                                                                                             VertexId to) const {
+    const auto [weights, prev_edges] = Search(from, to);
+    if (!weights[to]) {
+        return std::nullopt;
+    }
+    std::vector<EdgeId> edges;
+    for (std::optional<EdgeId> edge_id = prev_edges[to];
+         edge_id;
+         edge_id = prev_edges[graph_->GetEdge(*edge_id).from])
+    {
+        edges.push_back(*edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{*weights[to], std::move(edges)};
+}
+
+}  // namespace graph
@@ -0,0 +1,143 @@
+#include "flat_database.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace flat_db {
+
+namespace {
+
+constexpr char MAGIC[8] = { 'T', 'C', 'F', 'L', 'A', 'T', '\0', '\0' };
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t SECTION_ALIGNMENT = 8;
+
+size_t AlignUp(size_t offset) {
+	return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+}  // namespace
+
+Header MakeHeader(uint32_t edge_size) {
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byte_order_mark = BYTE_ORDER_MARK;
+	header.word_size = static_cast<uint32_t>(sizeof(size_t));
+	header.edge_size = edge_size;
+	return header;
+}
+
+bool IsFlatDatabase(const std::filesystem::path& path) {
+	std::ifstream input(path, std::ios::binary);
+	char magic[sizeof(MAGIC)] = {};
+	input.read(magic, sizeof(magic));
+	return input && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+//-------------------------Writer-------------------------
+
+Writer::Writer(uint32_t edge_size)
+	: header_(MakeHeader(edge_size)) {
+}
+
+void Writer::AddSection(SectionKind kind, const void* data, size_t size) {
+	sections_.push_back({ kind, static_cast<const char*>(data), size });
+}
+
+NameRef Writer::AddName(std::string_view name) {
+	NameRef result{ names_.size(), name.size() };
+	names_.append(name);
+	return result;
+}
+
+//Header, section table, then the sections in the order they were added, each starting at an aligned offset
+void Writer::Write(std::ostream& output) {
+	std::vector<Section> sections = sections_;
+	sections.push_back({ SectionKind::NAMES, names_.data(), names_.size() });
+	header_.section_count = sections.size();
+
+	std::vector<SectionEntry> entries;
+	size_t offset = AlignUp(sizeof(Header) + sections.size() * sizeof(SectionEntry));
+	for (const auto& section : sections) {
+		entries.push_back({ section.kind, 0, offset, section.size });
+		offset = AlignUp(offset + section.size);
+	}
+
+	static const char padding[SECTION_ALIGNMENT] = {};
+	size_t position = 0;
+	const auto write = [&output, &position](const void* data, size_t size) {
+		output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		position += size;
+	};
+	write(&header_, sizeof(Header));
+	write(entries.data(), entries.size() * sizeof(SectionEntry));
+	for (size_t index = 0; index < sections.size(); ++index) {
+		write(padding, entries[index].offset - position);
+		write(sections[index].data, sections[index].size);
+	}
+	if (!output) {
+		throw std::runtime_error("Can't write the database");
+	}
+}
+
+//-------------------------Reader-------------------------
+
+Reader::Reader(std::shared_ptr<const MappedFile> file, uint32_t edge_size)
+	: file_(std::move(file))
+{
+	const Header expected = MakeHeader(edge_size);
+	Header header;
+	if (file_->GetSize() < sizeof(Header)) {
+		throw std::runtime_error("Damaged database header");
+	}
+	std::memcpy(&header, file_->GetData(), sizeof(Header));
+	if (std::memcmp(header.magic, expected.magic, sizeof(MAGIC)) != 0 || header.version != expected.version) {
+		throw std::runtime_error("Unknown database format");
+	}
+	if (header.byte_order_mark != expected.byte_order_mark || header.word_size != expected.word_size
+		|| header.edge_size != expected.edge_size) {
+		throw std::runtime_error("The database was written by a build of another memory layout");
+	}
+	if (header.section_count > (file_->GetSize() - sizeof(Header)) / sizeof(SectionEntry)) {
+		throw std::runtime_error("Damaged database section table");
+	}
+	sections_.resize(header.section_count);
+	std::memcpy(sections_.data(), file_->GetData() + sizeof(Header), sections_.size() * sizeof(SectionEntry));
+	for (const auto& section : sections_) {
+		if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > file_->GetSize()
+			|| section.size > file_->GetSize() - section.offset) {
+			throw std::runtime_error("Damaged database section table");
+		}
+	}
+}
+
+bool Reader::HasSection(SectionKind kind) const {
+	return std::any_of(sections_.begin(), sections_.end(), [kind](const SectionEntry& section) {
+		return section.kind == kind;
+	});
+}
+
+std::string_view Reader::GetSection(SectionKind kind) const {
+	for (const auto& section : sections_) {
+		if (section.kind == kind) {
+			return { file_->GetData() + section.offset, static_cast<size_t>(section.size) };
+		}
+	}
+	throw std::runtime_error("Missing section in the database");
+}
+
+std::string_view Reader::GetName(const NameRef& name) const {
+	const std::string_view names = GetSection(SectionKind::NAMES);
+	if (name.offset > names.size() || name.size > names.size() - name.offset) {
+		throw std::runtime_error("Damaged name in the database");
+	}
+	return names.substr(name.offset, name.size);
+}
+
+const std::shared_ptr<const MappedFile>& Reader::GetFile() const {
+	return file_;
+}
+
+}  // namespace flat_db
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Database file made of fixed-layout sections, so process_requests can map it and use the large
+// arrays (the graph and the routes matrix) in place instead of parsing them.
+// Sections are found through the table after the header: the ones a batch doesn't need are never read.
+// The sections keep the in-memory layout of the build that wrote them: the header records the
+// byte order and the sizes of the stored records, a file of another layout is rejected
+namespace flat_db {
+
+enum class SectionKind : uint32_t {
+	NAMES, // stop and bus names one after another, referred to by NameRef
+	STOPS,
+	BUSES,
+	BUS_STOPS, // stop indexes of all buses, BusRecord points at its slice
+	DISTANCES,
+	RENDER_SETTINGS, // protobuf map_serialize.RenderSettings
+	ROUTE_BUILDER, // protobuf router_serialize.TransportRouter without the graph and the routes matrix
+	GRAPH_EDGES,
+	GRAPH_OFFSETS,
+	GRAPH_INCOMING_OFFSETS,
+	GRAPH_INCOMING_EDGES,
+	ROUTER_WEIGHTS,
+	ROUTER_PREV_EDGES,
+	BUS_STATS, // one BusStatsRecord per bus in the order of BUSES, absent in older files
+	MAP, // SVG document drawn at make_base
+	DEFLATED_MAP, // the same in ZLIB format, written instead of MAP with compress_map
+};
+
+struct NameRef {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+struct StopRecord {
+	NameRef name;
+	double latitude = 0;
+	double longitude = 0;
+};
+
+struct BusRecord {
+	NameRef name;
+	uint64_t first_stop = 0;
+	uint32_t stop_count = 0;
+	uint32_t is_roundtrip = 0;
+};
+
+struct BusStatsRecord {
+	uint64_t stop_count = 0;
+	uint64_t unique_stop_count = 0;
+	double route_length = 0;
+	double curvature = 0;
+};
+
+// Stops are given by their indexes in the STOPS section
+struct DistanceRecord {
+	uint32_t stop_from = 0;
+	uint32_t stop_to = 0;
+	double distance = 0;
+};
+
+struct Header {
+	char magic[8] = {};
+	uint32_t version = 0;
+	uint32_t byte_order_mark = 0;
+	uint32_t word_size = 0;
+	uint32_t edge_size = 0;
+	uint64_t section_count = 0;
+};
+
+struct SectionEntry {
+	SectionKind kind = SectionKind::NAMES;
+	uint32_t reserved = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+// Header fields of the running build, edge_size is the size of a graph edge record
+Header MakeHeader(uint32_t edge_size);
+
+bool IsFlatDatabase(const std::filesystem::path& path);
+
+// Collects sections and writes them aligned. The data isn't copied: it has to live until Write
+class Writer {
+public:
+
+	explicit Writer(uint32_t edge_size);
+
+	void AddSection(SectionKind kind, const void* data, size_t size);
+
+	template <typename T>
+	void AddArray(SectionKind kind, const T* data, size_t count) {
+		AddSection(kind, data, count * sizeof(T));
+	}
+
+	// Appends the name to the NAMES section kept by the writer
+	NameRef AddName(std::string_view name);
+
+	void Write(std::ostream& output);
+
+private:
+
+	struct Section {
+		SectionKind kind;
+		const char* data;
+		size_t size;
+	};
+
+	Header header_;
+	std::vector<Section> sections_;
+	std::string names_;
+
+};
+
+// Checks the header and the section table of a mapped file and hands out sections in place
+class Reader {
+public:
+
+	Reader(std::shared_ptr<const MappedFile> file, uint32_t edge_size);
+
+	bool HasSection(SectionKind kind) const;
+	std::string_view GetSection(SectionKind kind) const;
+
+	template <typename T>
+	std::pair<const T*, size_t> GetArray(SectionKind kind) const {
+		const std::string_view section = GetSection(kind);
+		if (section.size() % sizeof(T) != 0
+			|| reinterpret_cast<uintptr_t>(section.data()) % alignof(T) != 0) {
+			throw std::runtime_error("Damaged section in the database");
+		}
+		return { reinterpret_cast<const T*>(section.data()), section.size() / sizeof(T) };
+	}
+
+	std::string_view GetName(const NameRef& name) const;
+
+	const std::shared_ptr<const MappedFile>& GetFile() const;
+
+private:
+
+	std::shared_ptr<const MappedFile> file_;
+	std::vector<SectionEntry> sections_;
+
+};
+
+}  // namespace flat_db
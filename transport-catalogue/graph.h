@@ -1,8 +1,11 @@
 #pragma once
 
+#include "array_storage.h"
 #include "ranges.h"
 
 #include <cstdlib>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace graph {
@@ -17,86 +20,204 @@ struct Edge {
     Weight weight;
 };
 
+// Graph in compressed sparse row form: edges are packed in one array sorted by source vertex,
+// edges of vertex v have ids [offsets[v], offsets[v + 1]).
+// AddEdge only appends, Finalize sorts the edges and builds the offsets. Edge ids returned
+// by AddEdge are renumbered by Finalize; the order of edges of one vertex is kept.
+// Ids of the edges entering every vertex are kept in the same layout, a view of the transposed graph.
+// The arrays may be borrowed from a mapped database, such a graph copies them on the first change
 template <typename Weight>
 class DirectedWeightedGraph {
 public:
 
-    using IncidenceList = std::vector<EdgeId>;
-    using IncidentEdgesRange = ranges::Range<typename IncidenceList::const_iterator>;
+    using IncidentEdgesRange = ranges::Range<ranges::CountingIterator<EdgeId>>;
+    using IncomingEdgesRange = ranges::Range<const EdgeId*>;
 
     DirectedWeightedGraph() = default;
     explicit DirectedWeightedGraph(size_t vertex_count);
+    VertexId AddVertex();
     EdgeId AddEdge(const Edge<Weight>& edge);
+    void Finalize();
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+    IncomingEdgesRange GetIncomingEdges(VertexId vertex) const;
 
-    void SetEdges(const std::vector<Edge<Weight>>& edges);
-    void SetIncidenceList(const std::vector<IncidenceList>& incidence_lists);
+    // Fills a finalized graph directly, edges must be sorted by source to match the offsets
+    void SetEdges(std::vector<Edge<Weight>> edges, std::vector<EdgeId> offsets);
 
-    const std::vector<Edge<Weight>>& GetEdges() const;
-    const std::vector<IncidenceList>& GetIncidenceLists() const;
+    // Same with the incoming edges index built beforehand, e.g. arrays borrowed from a mapped database
+    void SetEdges(ArrayStorage<Edge<Weight>> edges, ArrayStorage<EdgeId> offsets,
+                  ArrayStorage<EdgeId> incoming_offsets, ArrayStorage<EdgeId> incoming_edges);
+
+    const ArrayStorage<Edge<Weight>>& GetEdges() const;
+    const ArrayStorage<EdgeId>& GetOffsets() const;
+    const ArrayStorage<EdgeId>& GetIncomingOffsets() const;
+    const ArrayStorage<EdgeId>& GetIncomingEdgeIds() const;
 
 private:
 
-    std::vector<Edge<Weight>> edges_;
-    std::vector<IncidenceList> incidence_lists_;
+    ArrayStorage<Edge<Weight>> edges_;
+    ArrayStorage<EdgeId> offsets_ = std::vector<EdgeId>{0};
+    ArrayStorage<EdgeId> incoming_offsets_ = std::vector<EdgeId>{0};
+    ArrayStorage<EdgeId> incoming_edges_;
+    bool is_finalized_ = true;
+
+    void BuildIncomingEdges();
 
 };
 
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {
+    : offsets_(vertex_count + 1, 0)
+    , incoming_offsets_(vertex_count + 1, 0) {
+}
+
+template <typename Weight>
+VertexId DirectedWeightedGraph<Weight>::AddVertex() {
+    auto& offsets = offsets_.GetOwned();
+    offsets.push_back(offsets.back());
+    auto& incoming_offsets = incoming_offsets_.GetOwned();
+    incoming_offsets.push_back(incoming_offsets.back());
+    return GetVertexCount() - 1;
 }
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
-    edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_.at(edge.from).push_back(id);
-    return id;
+    if (edge.from >= GetVertexCount() || edge.to >= GetVertexCount()) {
+        throw std::out_of_range("Edge vertex is out of range");
+    }
+    edges_.GetOwned().push_back(edge);
+    is_finalized_ = false;
+    return edges_.GetSize() - 1;
+}
+
+//Stable counting sort of the edges by source vertex
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Finalize() {
+    if (is_finalized_) {
+        return;
+    }
+    const size_t vertex_count = GetVertexCount();
+    auto& edges = edges_.GetOwned();
+    auto& offsets = offsets_.GetOwned();
+    offsets.assign(vertex_count + 1, 0);
+    for (const auto& edge : edges) {
+        ++offsets[edge.from + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        offsets[vertex + 1] += offsets[vertex];
+    }
+    std::vector<EdgeId> positions(offsets.begin(), offsets.end() - 1);
+    std::vector<Edge<Weight>> sorted_edges(edges.size());
+    for (auto& edge : edges) {
+        const VertexId from = edge.from;
+        sorted_edges[positions[from]++] = std::move(edge);
+    }
+    edges = std::move(sorted_edges);
+    BuildIncomingEdges();
+    is_finalized_ = true;
+}
+
+//Counting sort of the edge ids by target vertex
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::BuildIncomingEdges() {
+    const size_t vertex_count = GetVertexCount();
+    auto& incoming_offsets = incoming_offsets_.GetOwned();
+    incoming_offsets.assign(vertex_count + 1, 0);
+    for (const auto& edge : edges_) {
+        ++incoming_offsets[edge.to + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        incoming_offsets[vertex + 1] += incoming_offsets[vertex];
+    }
+    std::vector<EdgeId> positions(incoming_offsets.begin(), incoming_offsets.end() - 1);
+    auto& incoming_edges = incoming_edges_.GetOwned();
+    incoming_edges.resize(edges_.GetSize());
+    for (EdgeId edge_id = 0; edge_id < edges_.GetSize(); ++edge_id) {
+        incoming_edges[positions[edges_[edge_id].to]++] = edge_id;
+    }
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return offsets_.GetSize() - 1;
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetEdgeCount() const {
-    return edges_.size();
+    return edges_.GetSize();
 }
 
 template <typename Weight>
 const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
-    return edges_.at(edge_id);
+    return edges_[edge_id];
 }
 
 template <typename Weight>
-const std::vector<Edge<Weight>>& DirectedWeightedGraph<Weight>::GetEdges() const {
+const ArrayStorage<Edge<Weight>>& DirectedWeightedGraph<Weight>::GetEdges() const {
     return edges_;
 }
 
 template<typename Weight>
-const std::vector<typename DirectedWeightedGraph<Weight>::IncidenceList>& DirectedWeightedGraph<Weight>::GetIncidenceLists() const {
-    return incidence_lists_;
+const ArrayStorage<EdgeId>& DirectedWeightedGraph<Weight>::GetOffsets() const {
+    return offsets_;
+}
+
+template<typename Weight>
+const ArrayStorage<EdgeId>& DirectedWeightedGraph<Weight>::GetIncomingOffsets() const {
+    return incoming_offsets_;
+}
+
+template<typename Weight>
+const ArrayStorage<EdgeId>& DirectedWeightedGraph<Weight>::GetIncomingEdgeIds() const {
+    return incoming_edges_;
 }
 
 template<typename Weight>
-void DirectedWeightedGraph<Weight>::SetEdges(const std::vector<Edge<Weight>>& edges) {
-    edges_ = edges;
+void DirectedWeightedGraph<Weight>::SetEdges(std::vector<Edge<Weight>> edges, std::vector<EdgeId> offsets) {
+    if (offsets.empty() || offsets.back() != edges.size()) {
+        throw std::invalid_argument("Offsets don't match the edges");
+    }
+    edges_ = std::move(edges);
+    offsets_ = std::move(offsets);
+    BuildIncomingEdges();
+    is_finalized_ = true;
 }
 
 template<typename Weight>
-void DirectedWeightedGraph<Weight>::SetIncidenceList(const std::vector<IncidenceList>& incidence_lists) {
-    incidence_lists_ = incidence_lists;
+void DirectedWeightedGraph<Weight>::SetEdges(ArrayStorage<Edge<Weight>> edges, ArrayStorage<EdgeId> offsets,
+                                             ArrayStorage<EdgeId> incoming_offsets, ArrayStorage<EdgeId> incoming_edges) {
+    if (offsets.IsEmpty() || offsets[offsets.GetSize() - 1] != edges.GetSize()
+        || incoming_offsets.GetSize() != offsets.GetSize() || incoming_offsets[incoming_offsets.GetSize() - 1] != edges.GetSize()
+        || incoming_edges.GetSize() != edges.GetSize()) {
+        throw std::invalid_argument("Offsets don't match the edges");
+    }
+    edges_ = std::move(edges);
+    offsets_ = std::move(offsets);
+    incoming_offsets_ = std::move(incoming_offsets);
+    incoming_edges_ = std::move(incoming_edges);
+    is_finalized_ = true;
 }
 
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
-    return ranges::AsRange(incidence_lists_.at(vertex));
+    if (!is_finalized_) {
+        throw std::logic_error("Graph should be finalized before traversal");
+    }
+    return ranges::AsCountingRange(offsets_[vertex], offsets_[vertex + 1]);
+}
+
+template <typename Weight>
+typename DirectedWeightedGraph<Weight>::IncomingEdgesRange
+DirectedWeightedGraph<Weight>::GetIncomingEdges(VertexId vertex) const {
+    if (!is_finalized_) {
+        throw std::logic_error("Graph should be finalized before traversal");
+    }
+    return ranges::Range{incoming_edges_.GetData() + incoming_offsets_[vertex],
+                         incoming_edges_.GetData() + incoming_offsets_[vertex + 1]};
 }
-}  // namespace graph
\ No newline at end of file
+}  // namespace graph
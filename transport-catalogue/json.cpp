@@ -1,5 +1,9 @@
 #include "json.h"
 
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
 using namespace std;
 
 namespace json {
@@ -8,213 +12,232 @@ namespace json {
 
         //-------------------------LoadNode-----------------------
 
-        Node LoadNode(istream& input);
-
-        Node LoadNumber(std::istream& input) {
-            using namespace std::literals;
-
-            std::string parsed_num;
+        // Считывает поток целиком в один буфер, блоками, а не по символу
+        std::string ReadAll(std::istream& input) {
+            constexpr size_t MIN_CHUNK_SIZE = 1 << 16;
+            std::string buffer;
+            size_t size = 0;
+            do {
+                buffer.resize(std::max(size * 2, MIN_CHUNK_SIZE));
+                input.read(buffer.data() + size, static_cast<std::streamsize>(buffer.size() - size));
+                size += static_cast<size_t>(input.gcount());
+            } while (size == buffer.size());
+            buffer.resize(size);
+            return buffer;
+        }
 
-            // Считывает в parsed_num очередной символ из input
-            auto read_char = [&parsed_num, &input] {
-                parsed_num += static_cast<char>(input.get());
-                if (!input) {
-                    throw ParsingError("Failed to read number from stream"s);
-                }
-            };
+        // Разбирает документ, целиком лежащий в памяти, продвигая указатель на текущий символ
+        class Parser {
+        public:
+            Parser(const char* begin, const char* end)
+                : pos_(begin)
+                , end_(end) {
+            }
 
-            // Считывает одну или более цифр в parsed_num из input
-            auto read_digits = [&input, read_char] {
-                if (!std::isdigit(input.peek())) {
-                    throw ParsingError("A digit is expected"s);
+            Node LoadNode() {
+                switch (const char c = ReadNonSpace(); c) {
+                case '[':
+                    return LoadArray();
+                case '{':
+                    return LoadDict();
+                case '"':
+                    return Node(LoadString());
+                case 'f':
+                case 't':
+                case 'n':
+                    --pos_;
+                    return LoadBoolOrNull();
+                default:
+                    --pos_;
+                    return LoadNumber();
                 }
-                while (std::isdigit(input.peek())) {
-                    read_char();
-                }
-            };
-
-            if (input.peek() == '-') {
-                read_char();
-            }
-            // Парсинг целой части числа
-            if (input.peek() == '0') {
-                read_char();
-                // После 0 в JSON не могут идти другие цифры
-            }
-            else {
-                read_digits();
             }
 
-            bool is_int = true;
-            // Парсинг дробной части числа
-            if (input.peek() == '.') {
-                read_char();
-                read_digits();
-                is_int = false;
-            }
+        private:
+            const char* pos_;
+            const char* end_;
 
-            // Парсинг экспоненциальной части числа
-            if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-                read_char();
-                if (ch = input.peek(); ch == '+' || ch == '-') {
-                    read_char();
+            // Пропускает пробельные символы и возвращает следующий за ними
+            char ReadNonSpace() {
+                while (pos_ != end_ && IsSpace(*pos_)) {
+                    ++pos_;
                 }
-                read_digits();
-                is_int = false;
-            }
-
-            try {
-                if (is_int) {
-                    // Сначала пробуем преобразовать строку в int
-                    try {
-                        return Node(std::stoi(parsed_num));
-                    }
-                    catch (...) {
-                        // В случае неудачи, например, при переполнении,
-                        // код ниже попробует преобразовать строку в double
-                    }
+                if (pos_ == end_) {
+                    throw ParsingError("Unexpected end of document");
                 }
-                return Node(std::stod(parsed_num));
+                return *pos_++;
             }
-            catch (...) {
-                throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+
+            static bool IsSpace(char c) {
+                return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
             }
-        }
 
-        Node LoadBoolOrNull(std::istream& input) {
-            std::string parsed_value;
-            while (std::isalpha(input.peek())) {
-                parsed_value += static_cast<char>(input.get());
+            static bool IsDigit(char c) {
+                return c >= '0' && c <= '9';
             }
-            if (parsed_value == "true"s) return Node(true);
-            else if (parsed_value == "false"s) return Node(false);
-            else if (parsed_value == "null"s) return Node(nullptr);
-            else throw ParsingError("Error in parsing bool or null type");
-        }
 
+            Node LoadNumber() {
+                using namespace std::literals;
 
-        // Считывает содержимое строкового литерала JSON-документа
-        // Функцию следует использовать после считывания открывающего символа ":
-        Node LoadString(std::istream& input) {
-            using namespace std::literals;
+                const char* begin = pos_;
 
-            auto it = std::istreambuf_iterator<char>(input);
-            auto end = std::istreambuf_iterator<char>();
-            std::string s;
-            while (true) {
-                if (it == end) {
-                    // Поток закончился до того, как встретили закрывающую кавычку?
-                    throw ParsingError("String parsing error");
-                }
-                const char ch = *it;
-                if (ch == '"') {
-                    // Встретили закрывающую кавычку
-                    ++it;
-                    break;
-                }
-                else if (ch == '\\') {
-                    // Встретили начало escape-последовательности
-                    ++it;
-                    if (it == end) {
-                        // Поток завершился сразу после символа обратной косой черты
-                        throw ParsingError("String parsing error");
+                // Пропускает одну или более цифр
+                auto read_digits = [this] {
+                    if (pos_ == end_ || !IsDigit(*pos_)) {
+                        throw ParsingError("A digit is expected"s);
                     }
-                    const char escaped_char = *(it);
-                    // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
-                    switch (escaped_char) {
-                    case 'n':
-                        s.push_back('\n');
-                        break;
-                    case 't':
-                        s.push_back('\t');
-                        break;
-                    case 'r':
-                        s.push_back('\r');
-                        break;
-                    case '"':
-                        s.push_back('"');
-                        break;
-                    case '\\':
-                        s.push_back('\\');
-                        break;
-                    default:
-                        // Встретили неизвестную escape-последовательность
-                        throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+                    while (pos_ != end_ && IsDigit(*pos_)) {
+                        ++pos_;
                     }
+                };
+
+                if (pos_ != end_ && *pos_ == '-') {
+                    ++pos_;
                 }
-                else if (ch == '\n' || ch == '\r') {
-                    // Строковый литерал внутри- JSON не может прерываться символами \r или \n
-                    throw ParsingError("Unexpected end of line"s);
+                // Парсинг целой части числа
+                if (pos_ != end_ && *pos_ == '0') {
+                    ++pos_;
+                    // После 0 в JSON не могут идти другие цифры
                 }
                 else {
-                    // Просто считываем очередной символ и помещаем его в результирующую строку
-                    s.push_back(ch);
+                    read_digits();
                 }
-                ++it;
-            }
-
-            return Node(s);
-        }
 
-        Node LoadArray(istream& input) {
-            Array result;
-            auto it = std::istreambuf_iterator<char>(input);
-            auto end = std::istreambuf_iterator<char>();
-            if (it == end) {
-                throw ParsingError("Parsing Error");
-            }
-            for (char c; input >> c && c != ']';) {
-                if (c != ',') {
-                    input.putback(c);
+                bool is_int = true;
+                // Парсинг дробной части числа
+                if (pos_ != end_ && *pos_ == '.') {
+                    ++pos_;
+                    read_digits();
+                    is_int = false;
                 }
-                result.push_back(LoadNode(input));
-            }
-
-            return Node(move(result));
-        }
 
-        Node LoadDict(istream& input) {
-            Dict result;
-            auto it = std::istreambuf_iterator<char>(input);
-            auto end = std::istreambuf_iterator<char>();
-            if (it == end) {
-                throw ParsingError("Parsing Error");
-            }
-            for (char c; input >> c && c != '}';) {
-                if (c == ',') {
-                    input >> c;
+                // Парсинг экспоненциальной части числа
+                if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E')) {
+                    ++pos_;
+                    if (pos_ != end_ && (*pos_ == '+' || *pos_ == '-')) {
+                        ++pos_;
+                    }
+                    read_digits();
+                    is_int = false;
                 }
 
-                string key = Node(LoadString(input)).AsString();
-                input >> c;
-                result.insert({ move(key), LoadNode(input) });
+                if (is_int) {
+                    // Сначала пробуем преобразовать в int, при переполнении число читается как double
+                    int value = 0;
+                    if (std::from_chars(begin, pos_, value).ec == std::errc{}) {
+                        return Node(value);
+                    }
+                }
+                double value = 0;
+                if (const auto [end, error] = std::from_chars(begin, pos_, value); error != std::errc{} || end != pos_) {
+                    throw ParsingError("Failed to convert "s + std::string(begin, pos_) + " to number"s);
+                }
+                return Node(value);
             }
 
-            return Node(move(result));
-        }
-
-        Node LoadNode(istream& input) {
-            char c;
-            input >> c;
-
-            if (c == '[') {
-                return LoadArray(input);
-            }
-            else if (c == '{') {
-                return LoadDict(input);
+            Node LoadBoolOrNull() {
+                const char* begin = pos_;
+                while (pos_ != end_ && std::isalpha(static_cast<unsigned char>(*pos_))) {
+                    ++pos_;
+                }
+                const std::string_view parsed_value(begin, pos_ - begin);
+                if (parsed_value == "true"sv) return Node(true);
+                else if (parsed_value == "false"sv) return Node(false);
+                else if (parsed_value == "null"sv) return Node(nullptr);
+                else throw ParsingError("Error in parsing bool or null type");
             }
-            else if (c == '"') {
-                return LoadString(input);
+
+            // Считывает содержимое строкового литерала JSON-документа
+            // Функцию следует использовать после считывания открывающего символа ":
+            // участки без escape-последовательностей копируются целиком
+            std::string LoadString() {
+                using namespace std::literals;
+
+                std::string s;
+                const char* chunk = pos_;
+                while (true) {
+                    if (pos_ == end_) {
+                        // Документ закончился до того, как встретили закрывающую кавычку?
+                        throw ParsingError("String parsing error");
+                    }
+                    const char ch = *pos_;
+                    if (ch == '"') {
+                        // Встретили закрывающую кавычку
+                        s.append(chunk, pos_);
+                        ++pos_;
+                        return s;
+                    }
+                    else if (ch == '\\') {
+                        // Встретили начало escape-последовательности
+                        s.append(chunk, pos_);
+                        ++pos_;
+                        if (pos_ == end_) {
+                            // Документ завершился сразу после символа обратной косой черты
+                            throw ParsingError("String parsing error");
+                        }
+                        // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
+                        switch (const char escaped_char = *pos_; escaped_char) {
+                        case 'n':
+                            s.push_back('\n');
+                            break;
+                        case 't':
+                            s.push_back('\t');
+                            break;
+                        case 'r':
+                            s.push_back('\r');
+                            break;
+                        case '"':
+                            s.push_back('"');
+                            break;
+                        case '\\':
+                            s.push_back('\\');
+                            break;
+                        default:
+                            // Встретили неизвестную escape-последовательность
+                            throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+                        }
+                        ++pos_;
+                        chunk = pos_;
+                    }
+                    else if (ch == '\n' || ch == '\r') {
+                        // Строковый литерал внутри JSON не может прерываться символами \r или \n
+                        throw ParsingError("Unexpected end of line"s);
+                    }
+                    else {
+                        ++pos_;
+                    }
+                }
             }
-            else if (c == 'f' || c == 't' || c == 'n') {
-                input.putback(c);
-                return LoadBoolOrNull(input);
+
+            Node LoadArray() {
+                Array result;
+                for (char c = ReadNonSpace(); c != ']'; c = ReadNonSpace()) {
+                    if (c != ',') {
+                        --pos_;
+                    }
+                    result.push_back(LoadNode());
+                }
+                return Node(std::move(result));
             }
-            else {
-                input.putback(c);
-                return LoadNumber(input);
+
+            Node LoadDict() {
+                Dict result;
+                for (char c = ReadNonSpace(); c != '}'; c = ReadNonSpace()) {
+                    if (c == ',') {
+                        c = ReadNonSpace();
+                    }
+                    if (c != '"') {
+                        throw ParsingError("A key is expected");
+                    }
+                    std::string key = LoadString();
+                    if (ReadNonSpace() != ':') {
+                        throw ParsingError("':' is expected after a key");
+                    }
+                    result.emplace(std::move(key), LoadNode());
+                }
+                return Node(std::move(result));
             }
-        }
+        };
 
     }// namespace
 
@@ -412,7 +435,13 @@ namespace json {
     }
 
     Document Load(istream& input) {
-        return Document{ LoadNode(input) };
+        const std::string buffer = ReadAll(input);
+        return Load(std::string_view(buffer));
+    }
+
+    Document Load(std::string_view input) {
+        Parser parser(input.data(), input.data() + input.size());
+        return Document{ parser.LoadNode() };
     }
 
     void Print(const Document& doc, std::ostream& output) {
@@ -4,6 +4,7 @@
 #include <map>
 #include <cstddef>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -83,7 +84,9 @@ namespace json {
         Node root_;
     };
 
+    // Поток считывается целиком, документ разбирается из памяти
     Document Load(std::istream& input);
+    Document Load(std::string_view input);
 
     void Print(const Document& doc, std::ostream& output);
 
@@ -0,0 +1,123 @@
+// Parse time of json::Load on a requests document, built with -DTRANSPORT_CATALOGUE_BENCHMARKS=ON.
+// Usage: json_benchmark [file.json] [repeats]. Without a file a base_requests document of about 50 MB is generated
+// (the same one every run), shaped like make_base input: stops with coordinates and road distances, then buses.
+// Every figure is the best of the repeats, the parsed tree is destroyed outside the measurement.
+// The tree copy is what building the json::Node tree alone costs, no parser can go below it.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+#include "json_builder.h"
+#include "mapped_file.h"
+
+using namespace std::literals;
+
+namespace {
+
+std::string GenerateRequests() {
+    constexpr int STOP_COUNT = 150'000;
+    constexpr int BUS_COUNT = 20'000;
+    std::mt19937 generator(1);
+    const auto random_int = [&generator](int from, int to) {
+        return std::uniform_int_distribution<int>(from, to)(generator);
+    };
+    const auto random_name = [&](int index) {
+        static constexpr std::string_view LETTERS = "abcdefghij klmnopqrstuvwxyz"sv;
+        std::string name;
+        for (int length = random_int(5, 25); length > 0; --length) {
+            name += LETTERS[random_int(0, static_cast<int>(LETTERS.size()) - 1)];
+        }
+        return name + std::to_string(index);
+    };
+
+    std::vector<std::string> stop_names;
+    json::Array requests;
+    for (int index = 0; index < STOP_COUNT; ++index) {
+        stop_names.push_back(random_name(index));
+    }
+    for (int index = 0; index < STOP_COUNT; ++index) {
+        json::Dict distances;
+        for (int count = random_int(1, 8); count > 0; --count) {
+            distances[stop_names[random_int(0, STOP_COUNT - 1)]] = random_int(1, 100'000);
+        }
+        requests.push_back(json::Builder{}.StartDict()
+                               .Key("type"s).Value("Stop"s)
+                               .Key("name"s).Value(stop_names[index])
+                               .Key("latitude"s).Value(std::uniform_real_distribution<double>(-90, 90)(generator))
+                               .Key("longitude"s).Value(std::uniform_real_distribution<double>(-180, 180)(generator))
+                               .Key("road_distances"s).Value(std::move(distances))
+                               .EndDict().Build());
+    }
+    for (int index = 0; index < BUS_COUNT; ++index) {
+        json::Array stops;
+        for (int count = random_int(2, 60); count > 0; --count) {
+            stops.push_back(stop_names[random_int(0, STOP_COUNT - 1)]);
+        }
+        requests.push_back(json::Builder{}.StartDict()
+                               .Key("type"s).Value("Bus"s)
+                               .Key("name"s).Value(random_name(index))
+                               .Key("stops"s).Value(std::move(stops))
+                               .Key("is_roundtrip"s).Value(random_int(0, 1) == 1)
+                               .EndDict().Build());
+    }
+    std::ostringstream output;
+    json::Print(json::Document(json::Builder{}.StartDict().Key("base_requests"s).Value(std::move(requests))
+                                   .EndDict().Build()), output);
+    return output.str();
+}
+
+template <typename Function>
+double MeasureBest(int repeats, Function function) {
+    double best = std::numeric_limits<double>::max();
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        const auto start = std::chrono::steady_clock::now();
+        [[maybe_unused]] const auto result = function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void Report(std::string_view name, double seconds, size_t size) {
+    std::cout << std::left << std::setw(28) << name << std::fixed << std::setprecision(3) << seconds << " s  "
+              << std::setprecision(1) << static_cast<double>(size) / seconds / 1e6 << " MB/s\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const std::string path = argc > 1 ? argv[1] : "json_benchmark_input.json"s;
+    const int repeats = argc > 2 ? std::stoi(argv[2]) : 11;
+    if (argc <= 1) {
+        std::ofstream(path, std::ios::binary) << GenerateRequests();
+    }
+    std::ifstream file(path, std::ios::binary);
+    const std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::cout << path << ": " << data.size() << " bytes, best of " << repeats << '\n';
+
+    Report("Load(istream)"sv, MeasureBest(repeats, [&data] {
+        std::istringstream input(data);
+        return json::Load(input);
+    }), data.size());
+    Report("Load(string_view)"sv, MeasureBest(repeats, [&data] {
+        return json::Load(std::string_view(data));
+    }), data.size());
+    Report("Load(mapped file)"sv, MeasureBest(repeats, [&path] {
+        const MappedFile input(path);
+        return json::Load(std::string_view(input.GetData(), input.GetSize()));
+    }), data.size());
+    const json::Document document = json::Load(std::string_view(data));
+    Report("tree copy"sv, MeasureBest(repeats, [&document] {
+        return document.GetRoot();
+    }), data.size());
+}
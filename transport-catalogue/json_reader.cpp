@@ -10,10 +10,24 @@ JsonReader::JsonReader(std::istream& input)
 {
 }
 
+JsonReader::JsonReader(std::string_view input)
+    : requests_data_(json::Load(input))
+{
+}
+
 SerializeSettings JsonReader::GetSerializationSettings() const {
     SerializeSettings settings;
     const auto& serialize_settings = requests_data_.GetRoot().AsMap().at("serialization_settings"s).AsMap();
     settings.path_to_db = serialize_settings.at("file"s).AsString();
+    if (serialize_settings.count("format"s)) {
+        settings.format = ParseDatabaseFormat(serialize_settings.at("format"s).AsString());
+    }
+    if (serialize_settings.count("compress_blocks"s)) {
+        settings.is_block_compressed = serialize_settings.at("compress_blocks"s).AsBool();
+    }
+    if (serialize_settings.count("compress_map"s)) {
+        settings.is_map_compressed = serialize_settings.at("compress_map"s).AsBool();
+    }
     return settings;
 }
 
@@ -56,9 +70,91 @@ RoutingSettings JsonReader::GetRoutingSettings() const {
     const auto& routing_settings = requests_data_.GetRoot().AsMap().at("routing_settings"s).AsMap();
     result.bus_wait_time_min = routing_settings.at("bus_wait_time"s).AsInt();
     result.bus_velocity_kmph = routing_settings.at("bus_velocity"s).AsDouble();
+    if (routing_settings.count("router_type"s)) {
+        result.router_type = ParseRouterType(routing_settings.at("router_type"s).AsString());
+    }
+    if (routing_settings.count("graph_model"s)) {
+        result.graph_model = ParseGraphModel(routing_settings.at("graph_model"s).AsString());
+    }
+    if (routing_settings.count("vertex_order"s)) {
+        result.vertex_order = ParseVertexOrder(routing_settings.at("vertex_order"s).AsString());
+    }
+    if (routing_settings.count("route_cache_size"s)) {
+        const int route_cache_size = routing_settings.at("route_cache_size"s).AsInt();
+        if (route_cache_size < 0) {
+            throw std::invalid_argument("Route cache size should be non-negative"s);
+        }
+        result.route_cache_size = static_cast<size_t>(route_cache_size);
+    }
+    if (routing_settings.count("lazy_router_memory_mb"s)) {
+        const int lazy_router_memory_mb = routing_settings.at("lazy_router_memory_mb"s).AsInt();
+        if (lazy_router_memory_mb < 0) {
+            throw std::invalid_argument("Lazy router memory budget should be non-negative"s);
+        }
+        result.lazy_router_memory_mb = static_cast<size_t>(lazy_router_memory_mb);
+    }
+    if (routing_settings.count("astar_landmarks"s)) {
+        const int astar_landmarks = routing_settings.at("astar_landmarks"s).AsInt();
+        if (astar_landmarks < 0) {
+            throw std::invalid_argument("Landmarks count should be non-negative"s);
+        }
+        result.astar_landmarks = static_cast<size_t>(astar_landmarks);
+    }
     return result;
 }
 
+RouterType JsonReader::ParseRouterType(const std::string& router_type) const {
+    if (router_type == "all_pairs"s) {
+        return RouterType::ALL_PAIRS;
+    }
+    if (router_type == "dijkstra"s) {
+        return RouterType::DIJKSTRA;
+    }
+    if (router_type == "contraction_hierarchies"s) {
+        return RouterType::CONTRACTION_HIERARCHIES;
+    }
+    if (router_type == "raptor"s) {
+        return RouterType::RAPTOR;
+    }
+    if (router_type == "lazy"s) {
+        return RouterType::LAZY;
+    }
+    if (router_type == "astar"s) {
+        return RouterType::ASTAR;
+    }
+    throw std::invalid_argument("Invalid router type"s);
+}
+
+GraphModel JsonReader::ParseGraphModel(const std::string& graph_model) const {
+    if (graph_model == "stop_pairs"s) {
+        return GraphModel::STOP_PAIRS;
+    }
+    if (graph_model == "route_patterns"s) {
+        return GraphModel::ROUTE_PATTERNS;
+    }
+    throw std::invalid_argument("Invalid graph model"s);
+}
+
+VertexOrder JsonReader::ParseVertexOrder(const std::string& vertex_order) const {
+    if (vertex_order == "alphabetical"s) {
+        return VertexOrder::ALPHABETICAL;
+    }
+    if (vertex_order == "hilbert"s) {
+        return VertexOrder::HILBERT;
+    }
+    throw std::invalid_argument("Invalid vertex order"s);
+}
+
+DatabaseFormat JsonReader::ParseDatabaseFormat(const std::string& format) const {
+    if (format == "protobuf"s) {
+        return DatabaseFormat::PROTOBUF;
+    }
+    if (format == "flat"s) {
+        return DatabaseFormat::FLAT;
+    }
+    throw std::invalid_argument("Invalid database format"s);
+}
+
 //-------------------------BaseRequestsProcession-------------------------
 
 void JsonReader::BaseRequestsParsing(TransportCatalogue& catalogue) const {
@@ -123,6 +219,100 @@ void JsonReader::CompleteAddBus(TransportCatalogue& catalogue, const Dict& reque
     catalogue.AddBus(route_name, route_type, route_stops);
 }
 
+//-------------------------PatchRequestsProcession-------------------------
+
+void JsonReader::PatchRequestsParsing(const TransportCatalogue& base, TransportCatalogue& catalogue) const {
+    std::map<std::string, geo::Coordinates> stops;
+    std::map<std::pair<std::string, std::string>, double> distances;
+    std::map<std::string, std::pair<RouteType, std::vector<std::string>>> buses;
+    for (const auto& stop : base.GetStops()) {
+        stops[stop.stop_name] = stop.coordinates;
+    }
+    for (const auto& [stop_pair, distance] : base.GetDistances()) {
+        distances[{stop_pair.first->stop_name, stop_pair.second->stop_name}] = distance;
+    }
+    for (const auto& route : base.GetRoutes()) {
+        auto& [route_type, route_stops] = buses[route.route_name];
+        route_type = route.route_type;
+        for (const Stop* stop : route.route_stops) {
+            route_stops.push_back(stop->stop_name);
+        }
+    }
+
+    const auto& patch_requests = requests_data_.GetRoot().AsMap().at("patch_requests"s).AsArray();
+    for (const auto& request : patch_requests) {
+        const auto& request_data = request.AsMap();
+        const std::string& name = request_data.at("name"s).AsString();
+        const bool is_removal = request_data.count("remove"s) && request_data.at("remove"s).AsBool();
+        if (request_data.at("type"s) == "Stop"s) {
+            if (is_removal) {
+                if (!stops.erase(name)) {
+                    throw std::invalid_argument("Unknown stop "s + name);
+                }
+                for (auto it = distances.begin(); it != distances.end();) {
+                    it = it->first.first == name || it->first.second == name ? distances.erase(it) : std::next(it);
+                }
+                continue;
+            }
+            if (request_data.count("latitude"s) || !stops.count(name)) {
+                stops[name] = {request_data.at("latitude"s).AsDouble(), request_data.at("longitude"s).AsDouble()};
+            }
+            if (request_data.count("road_distances"s)) {
+                for (const auto& [stop_to, distance] : request_data.at("road_distances"s).AsMap()) {
+                    distances[{name, stop_to}] = distance.AsDouble();
+                }
+            }
+        }
+        else if (request_data.at("type"s) == "Bus"s) {
+            if (is_removal) {
+                if (!buses.erase(name)) {
+                    throw std::invalid_argument("Unknown bus "s + name);
+                }
+                continue;
+            }
+            auto& [route_type, route_stops] = buses[name];
+            route_type = request_data.at("is_roundtrip"s).AsBool() ? RouteType::RING_ROUTE : RouteType::LINER_ROUTE;
+            route_stops.clear();
+            for (const auto& stop : request_data.at("stops"s).AsArray()) {
+                route_stops.push_back(stop.AsString());
+            }
+        }
+        else {
+            throw std::invalid_argument("Invalid request type"s);
+        }
+    }
+
+    //Requests may refer to the stops added later in the patch, so the references are checked at the end
+    for (const auto& [stop_pair, _] : distances) {
+        if (!stops.count(stop_pair.second)) {
+            throw std::invalid_argument("Unknown stop "s + stop_pair.second);
+        }
+    }
+    for (const auto& [name, route] : buses) {
+        for (const auto& stop_name : route.second) {
+            if (!stops.count(stop_name)) {
+                throw std::invalid_argument("Bus "s + name + " stops at unknown stop "s + stop_name);
+            }
+        }
+    }
+
+    for (const auto& [name, coordinates] : stops) {
+        catalogue.AddStop(Stop(name, coordinates));
+    }
+    for (const auto& [stop_pair, distance] : distances) {
+        catalogue.SetDistance(catalogue.FindStop(stop_pair.first)->stop_name,
+                              catalogue.FindStop(stop_pair.second)->stop_name,
+                              distance);
+    }
+    for (const auto& [name, route] : buses) {
+        std::vector<std::string_view> route_stops;
+        for (const auto& stop_name : route.second) {
+            route_stops.push_back(catalogue.FindStop(stop_name)->stop_name);
+        }
+        catalogue.AddBus(name, route.first, route_stops);
+    }
+}
+
 //-------------------------StatRequestsProcession-------------------------
 
 void JsonReader::StatRequestsParsing(const TransportCatalogue& catalogue, const std::string& map, 
@@ -141,6 +331,12 @@ void JsonReader::StatRequestsParsing(const TransportCatalogue& catalogue, const
         else if (request_data.at("type"s) == "Map"s) {
             out_json_builder.Value(GetMapDrawingResult(map, request_data));
         }
+        else if (request_data.at("type"s) == "Matrix"s) {
+            out_json_builder.Value(GetTravelTimeMatrixResult(route_builder, request_data));
+        }
+        else if (request_data.at("type"s) == "Isochrone"s) {
+            out_json_builder.Value(GetIsochroneResult(route_builder, request_data));
+        }
         else if (request_data.at("type"s) == "Route"s) {
             out_json_builder.Value(GetRouteBuildingResult(route_builder, request_data));
         }
@@ -152,6 +348,14 @@ void JsonReader::StatRequestsParsing(const TransportCatalogue& catalogue, const
     Print(Document(out_json_builder.Build()), out);
 }
 
+//Checked before the database is loaded, so that only the parts the batch asks for are read
+bool JsonReader::HasStatRequest(const std::string& type) const {
+    const auto& stat_requests = requests_data_.GetRoot().AsMap().at("stat_requests"s).AsArray();
+    return std::any_of(stat_requests.begin(), stat_requests.end(), [&type](const Node& request) {
+        return request.AsMap().at("type"s) == type;
+    });
+}
+
 Node::Value JsonReader::GetRouteRequestResult(const TransportCatalogue& catalogue, const Dict& request) const {
     auto result = catalogue.GetBusInfo(request.at("name"s).AsString());
     Node json_out;
@@ -203,10 +407,9 @@ json::Node::Value JsonReader::GetMapDrawingResult(const std::string& map, const
 
 json::Node::Value JsonReader::GetRouteBuildingResult(const RouteBuilder& route_builder, const json::Dict& request) const {
     Node json_out;
-    const auto& graph = route_builder.GetRouteGraph();
     const std::string stop_from = request.at("from"s).AsString();
     const std::string stop_to = request.at("to"s).AsString();
-    auto result = route_builder.BuildRouteBetweenTwoStops(stop_from, stop_to);
+    auto result = route_builder.BuildItinerary(stop_from, stop_to);
     if (!result.has_value()) {
         json_out = Builder{}.StartDict()
                             .Key("request_id"s).Value(request.at("id"s).AsInt())
@@ -217,26 +420,85 @@ json::Node::Value JsonReader::GetRouteBuildingResult(const RouteBuilder& route_b
     Builder json_builder;
     json_builder.StartDict()
                 .Key("request_id"s).Value(request.at("id"s).AsInt())
-                .Key("total_time"s).Value(result.value().weight.spend_time)
+                .Key("total_time"s).Value(result.value().total_time)
                 .Key("items"s).StartArray();
-    for (const auto edge_id : result.value().edges) {
-        const auto& edge = graph.GetEdge(edge_id);
-        if (edge.weight.span_count == 0) {
+    for (const auto& item : result.value().items) {
+        if (item.kind == EdgeKind::WAIT) {
             json_builder.StartDict()
                         .Key("type"s).Value("Wait"s)
-                        .Key("stop_name").Value(std::string(edge.weight.edge_type))
-                        .Key("time"s).Value(edge.weight.spend_time)
+                        .Key("stop_name").Value(std::string(item.name))
+                        .Key("time"s).Value(item.time)
                         .EndDict();
         }
         else {
             json_builder.StartDict()
                         .Key("type"s).Value("Bus"s)
-                        .Key("bus").Value(std::string(edge.weight.edge_type))
-                        .Key("span_count"s).Value(edge.weight.span_count)
-                        .Key("time"s).Value(edge.weight.spend_time)
+                        .Key("bus").Value(std::string(item.name))
+                        .Key("span_count"s).Value(item.span_count)
+                        .Key("time"s).Value(item.time)
                         .EndDict();
         }
     }
     json_out = json_builder.EndArray().EndDict().Build();
     return json_out.GetValue();
-}
\ No newline at end of file
+}
+
+//Rows follow "from", columns follow "to"; unknown stops and unreachable pairs get null
+json::Node::Value JsonReader::GetTravelTimeMatrixResult(const RouteBuilder& route_builder, const json::Dict& request) const {
+    std::vector<std::string_view> sources;
+    for (const auto& stop : request.at("from"s).AsArray()) {
+        sources.push_back(stop.AsString());
+    }
+    std::vector<std::string_view> targets;
+    for (const auto& stop : request.at("to"s).AsArray()) {
+        targets.push_back(stop.AsString());
+    }
+    const TravelTimeMatrix matrix = route_builder.BuildTravelTimeMatrix(sources, targets);
+    Array times;
+    Array transfers;
+    for (size_t source_index = 0; source_index < matrix.source_count; ++source_index) {
+        Array times_row;
+        Array transfers_row;
+        for (size_t target_index = 0; target_index < matrix.target_count; ++target_index) {
+            const size_t index = source_index * matrix.target_count + target_index;
+            if (matrix.times[index]) {
+                times_row.emplace_back(*matrix.times[index]);
+                transfers_row.emplace_back(matrix.transfers[index]);
+            }
+            else {
+                times_row.emplace_back(nullptr);
+                transfers_row.emplace_back(nullptr);
+            }
+        }
+        times.emplace_back(std::move(times_row));
+        transfers.emplace_back(std::move(transfers_row));
+    }
+    return Builder{}.StartDict()
+                    .Key("request_id"s).Value(request.at("id"s).AsInt())
+                    .Key("times"s).Value(std::move(times))
+                    .Key("transfers"s).Value(std::move(transfers))
+                    .EndDict().Build().GetValue();
+}
+
+json::Node::Value JsonReader::GetIsochroneResult(const RouteBuilder& route_builder, const json::Dict& request) const {
+    const bool is_arrive_by = request.count("arrive_by"s) && request.at("arrive_by"s).AsBool();
+    const auto result = route_builder.BuildIsochrone(request.at("stop"s).AsString(),
+                                                     request.at("max_time"s).AsDouble(), is_arrive_by);
+    if (!result.has_value()) {
+        return Builder{}.StartDict()
+                        .Key("request_id"s).Value(request.at("id"s).AsInt())
+                        .Key("error_message"s).Value("not found"s)
+                        .EndDict().Build().GetValue();
+    }
+    Builder json_builder;
+    json_builder.StartDict()
+                .Key("request_id"s).Value(request.at("id"s).AsInt())
+                .Key("stops"s).StartArray();
+    for (const auto& stop : result.value()) {
+        json_builder.StartDict()
+                    .Key("stop_name"s).Value(std::string(stop.name))
+                    .Key("time"s).Value(stop.time)
+                    .EndDict();
+    }
+    return json_builder.EndArray().EndDict().Build().GetValue();
+}
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <exception>
+#include <map>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -23,12 +25,20 @@ public:
 
 	JsonReader() = delete;
 	explicit JsonReader(std::istream&);
+	explicit JsonReader(std::string_view input);
 
 	void BaseRequestsParsing(TransportCatalogue& catalogue) const;
 
+	// Fills the catalogue with the base one changed by "patch_requests". Stop and Bus requests of the base requests
+	// format add the object or replace the one of the same name, "remove": true deletes it.
+	// Road distances of a stop are set over its old ones, coordinates of a known stop may be left out
+	void PatchRequestsParsing(const TransportCatalogue& base, TransportCatalogue& catalogue) const;
+
 	void StatRequestsParsing(const TransportCatalogue& catalogue, const std::string& map, 
 		                     const RouteBuilder& route_builder, std::ostream&) const;
 
+	bool HasStatRequest(const std::string& type) const;
+
 	SerializeSettings GetSerializationSettings() const;
 	RenderSettings GetRenderSettings() const;
 	RoutingSettings GetRoutingSettings() const;
@@ -48,7 +58,13 @@ private:
 	json::Node::Value GetStopRequestResult(const TransportCatalogue&, const json::Dict& request) const;
 	json::Node::Value GetMapDrawingResult(const std::string& map, const json::Dict& request) const;
 	json::Node::Value GetRouteBuildingResult(const RouteBuilder&, const json::Dict& request) const;
+	json::Node::Value GetTravelTimeMatrixResult(const RouteBuilder&, const json::Dict& request) const;
+	json::Node::Value GetIsochroneResult(const RouteBuilder&, const json::Dict& request) const;
 
 	svg::Color ParseColor(const json::Node&) const;
+	RouterType ParseRouterType(const std::string&) const;
+	GraphModel ParseGraphModel(const std::string&) const;
+	VertexOrder ParseVertexOrder(const std::string&) const;
+	DatabaseFormat ParseDatabaseFormat(const std::string&) const;
 
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bounded least-recently-used cache split into independently locked shards, so lookups from
+// several threads rarely wait for each other. Every shard evicts on its own once it holds its share of entries.
+// The shares add up to the capacity exactly, and small caches get fewer shards so no share is tiny
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLruCache {
+public:
+
+	struct Stats {
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	explicit ShardedLruCache(size_t capacity, size_t shard_count = DEFAULT_SHARD_COUNT)
+		: shards_(std::clamp<size_t>(std::min(shard_count, capacity / MIN_SHARD_CAPACITY), 1, MAX_SHARD_COUNT)) {
+		for (size_t index = 0; index < shards_.size(); ++index) {
+			shards_[index].capacity = capacity / shards_.size() + (index < capacity % shards_.size() ? 1 : 0);
+		}
+	}
+
+	std::optional<Value> Find(const Key& key) {
+		Shard& shard = GetShard(key);
+		std::lock_guard lock(shard.mutex);
+		const auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			misses_.fetch_add(1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		hits_.fetch_add(1, std::memory_order_relaxed);
+		return it->second->second;
+	}
+
+	void Insert(const Key& key, Value value) {
+		Shard& shard = GetShard(key);
+		if (shard.capacity == 0) {
+			return;
+		}
+		std::lock_guard lock(shard.mutex);
+		if (const auto it = shard.index.find(key); it != shard.index.end()) {
+			it->second->second = std::move(value);
+			shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+			return;
+		}
+		shard.entries.emplace_front(key, std::move(value));
+		shard.index.emplace(key, shard.entries.begin());
+		if (shard.entries.size() > shard.capacity) {
+			shard.index.erase(shard.entries.back().first);
+			shard.entries.pop_back();
+		}
+	}
+
+	Stats GetStats() const {
+		return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed) };
+	}
+
+private:
+
+	static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+	static constexpr size_t MAX_SHARD_COUNT = 256;
+	static constexpr size_t MIN_SHARD_CAPACITY = 8;
+
+	struct Shard {
+		std::mutex mutex;
+		size_t capacity = 0;
+		std::list<std::pair<Key, Value>> entries; // most recently used first
+		std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index;
+	};
+
+	std::vector<Shard> shards_;
+	std::atomic<size_t> hits_ = 0;
+	std::atomic<size_t> misses_ = 0;
+
+	Shard& GetShard(const Key& key) {
+		return shards_[Hash{}(key) % shards_.size()];
+	}
+
+};
@@ -8,36 +8,86 @@
 #include "transport_catalogue.h"
 #include "transport_router.h"
 #include "map_renderer.h"
+#include "mapped_file.h"
 
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|patch_base|process_requests]\n"sv;
+}
+
+//Requests are parsed from one buffer: stdin redirected from a file is mapped, a pipe is read whole
+JsonReader ReadRequests() {
+    constexpr int STANDARD_INPUT = 0;
+    if (MappedFile::IsMappable(STANDARD_INPUT)) {
+        const MappedFile input(STANDARD_INPUT);
+        return JsonReader(std::string_view(input.GetData(), input.GetSize()));
+    }
+    return JsonReader(std::cin);
 }
 
 void MakeBase() {
     TransportCatalogue catalogue;
     Serializer serializer;
-    JsonReader json_reader(std::cin);
+    const JsonReader json_reader = ReadRequests();
     serializer.SetSettings(json_reader.GetSerializationSettings());
     json_reader.BaseRequestsParsing(catalogue);
+    catalogue.ComputeBusInfo();
     MapRender render(catalogue.GetCoordinates(), json_reader.GetRenderSettings());
     RequestHandler handler(catalogue, render, json_reader.GetRoutingSettings());
     handler.BuildGraph();
-    serializer.SaveToFile(catalogue, json_reader.GetRenderSettings(), handler.GetRouteBuilder());
+    serializer.SaveToFile(catalogue, json_reader.GetRenderSettings(), handler.GetRouteBuilder(), handler.RenderMap());
+}
+
+//Rewrites the database with the patch requests applied. The routes matrix keeps the routes the patch can't change,
+//render and routing settings stay as they were
+void PatchBase() {
+    TransportCatalogue base_catalogue;
+    const JsonReader json_reader = ReadRequests();
+    SerializeSettings serialize_settings = json_reader.GetSerializationSettings();
+    if (!serialize_settings.format) {
+        serialize_settings.format = flat_db::IsFlatDatabase(serialize_settings.path_to_db) ? DatabaseFormat::FLAT
+                                                                                         : DatabaseFormat::PROTOBUF;
+    }
+    Serializer serializer(serialize_settings);
+    RequestHandler base_handler(base_catalogue);
+    const RenderSettings render_settings = serializer.GetFromFile(base_catalogue, base_handler.GetRouteBuilder());
+    base_handler.PrepareRouteBuilder();
+
+    TransportCatalogue catalogue;
+    json_reader.PatchRequestsParsing(base_catalogue, catalogue);
+    catalogue.ComputeBusInfo();
+    MapRender render(catalogue.GetCoordinates(), render_settings);
+    RequestHandler handler(catalogue, render, base_handler.GetRouteBuilder().GetRoutingSettings());
+    handler.PatchGraph(base_handler.GetRouteBuilder());
+    serializer.SaveToFile(catalogue, render_settings, handler.GetRouteBuilder(), handler.RenderMap());
 }
 
 void Complete() {
     TransportCatalogue catalogue;
     Serializer serializer;
-    JsonReader json_reader(std::cin);
+    const JsonReader json_reader = ReadRequests();
     serializer.SetSettings(json_reader.GetSerializationSettings());
     RequestHandler handler(catalogue);
-    RenderSettings render_settings = serializer.GetFromFile(catalogue, handler.GetRouteBuilder());
-    MapRender render(catalogue.GetCoordinates(), render_settings);
-    handler.SetRender(render);
-    handler.GetRouteBuilder().SetStopToVertexId(catalogue.GetStopNames());
-    std::string map = handler.RenderMap();
+    const bool is_router_needed = json_reader.HasStatRequest("Route"s) || json_reader.HasStatRequest("Matrix"s)
+                                  || json_reader.HasStatRequest("Isochrone"s);
+    const bool is_map_needed = json_reader.HasStatRequest("Map"s);
+    std::optional<std::string> stored_map;
+    RenderSettings render_settings = serializer.GetFromFile(catalogue, handler.GetRouteBuilder(), is_router_needed,
+                                                            is_map_needed ? &stored_map : nullptr);
+    if (is_router_needed) {
+        handler.PrepareRouteBuilder();
+    }
+    //The map is drawn here only for a database written without one
+    std::string map;
+    if (stored_map) {
+        map = std::move(*stored_map);
+    }
+    else if (is_map_needed) {
+        MapRender render(catalogue.GetCoordinates(), render_settings);
+        handler.SetRender(render);
+        map = handler.RenderMap();
+    }
     json_reader.StatRequestsParsing(catalogue, map, handler.GetRouteBuilder(), std::cout);
 }
 
@@ -52,6 +102,9 @@ int main(int argc, char* argv[]) {
     if (mode == "make_base"sv) {
         MakeBase();
     }
+    else if (mode == "patch_base"sv) {
+        PatchBase();
+    }
     else if (mode == "process_requests"sv) {
         Complete();
     }
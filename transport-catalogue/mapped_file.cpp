@@ -0,0 +1,146 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+
+namespace {
+
+HANDLE GetDescriptorHandle(int descriptor) {
+	return reinterpret_cast<HANDLE>(_get_osfhandle(descriptor));
+}
+
+}  // namespace
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+	                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Can't open " + path.string());
+	}
+	try {
+		Map(file, path.string());
+	}
+	catch (...) {
+		CloseHandle(file);
+		throw;
+	}
+	//The view stays valid after the file handle is closed
+	CloseHandle(file);
+}
+
+MappedFile::MappedFile(int descriptor) {
+	const HANDLE file = GetDescriptorHandle(descriptor);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Can't map descriptor " + std::to_string(descriptor));
+	}
+	Map(file, "descriptor " + std::to_string(descriptor));
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+	}
+}
+
+bool MappedFile::IsMappable(int descriptor) {
+	const HANDLE file = GetDescriptorHandle(descriptor);
+	return file != INVALID_HANDLE_VALUE && GetFileType(file) == FILE_TYPE_DISK;
+}
+
+void MappedFile::Map(void* file, const std::string& name) {
+	LARGE_INTEGER file_size {};
+	if (!GetFileSizeEx(file, &file_size)) {
+		throw std::runtime_error("Can't read the size of " + name);
+	}
+	size_ = static_cast<size_t>(file_size.QuadPart);
+	//An empty file can't be mapped, it's left as an empty view
+	if (size_ == 0) {
+		return;
+	}
+	const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		throw std::runtime_error("Can't map " + name);
+	}
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	//The view keeps the mapping object alive
+	CloseHandle(mapping);
+	if (data == nullptr) {
+		throw std::runtime_error("Can't map " + name);
+	}
+	data_ = static_cast<const char*>(data);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		throw std::runtime_error("Can't open " + path.string());
+	}
+	try {
+		Map(descriptor, path.string());
+	}
+	catch (...) {
+		close(descriptor);
+		throw;
+	}
+	//The mapping stays valid after the descriptor is closed
+	close(descriptor);
+}
+
+MappedFile::MappedFile(int descriptor) {
+	Map(descriptor, "descriptor " + std::to_string(descriptor));
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+}
+
+//Only a regular file read from its start, a pipe or a terminal can't be mapped
+bool MappedFile::IsMappable(int descriptor) {
+	struct stat file_stat {};
+	return fstat(descriptor, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && lseek(descriptor, 0, SEEK_CUR) == 0;
+}
+
+void MappedFile::Map(int descriptor, const std::string& name) {
+	struct stat file_stat {};
+	if (fstat(descriptor, &file_stat) != 0) {
+		throw std::runtime_error("Can't read the size of " + name);
+	}
+	size_ = static_cast<size_t>(file_stat.st_size);
+	//An empty file can't be mapped, it's left as an empty view
+	if (size_ == 0) {
+		return;
+	}
+	void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (data == MAP_FAILED) {
+		throw std::runtime_error("Can't map " + name);
+	}
+	data_ = static_cast<const char*>(data);
+}
+
+#endif
+
+const char* MappedFile::GetData() const {
+	return data_;
+}
+
+size_t MappedFile::GetSize() const {
+	return size_;
+}
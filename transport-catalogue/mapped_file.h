@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+// Read-only view of a whole file mapped into memory, unmapped on destruction
+class MappedFile {
+public:
+
+	explicit MappedFile(const std::filesystem::path& path);
+	// Maps the file an open descriptor refers to, the descriptor stays open
+	explicit MappedFile(int descriptor);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	// Whether the descriptor is a file that can be mapped whole
+	static bool IsMappable(int descriptor);
+
+	const char* GetData() const;
+	size_t GetSize() const;
+
+private:
+
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+
+#ifdef _WIN32
+	void Map(void* file, const std::string& name);
+#else
+	void Map(int descriptor, const std::string& name);
+#endif
+
+};
@@ -0,0 +1,162 @@
+#include "min_plus_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIN_PLUS_X86 1
+#define MIN_PLUS_TARGET_AVX2 __attribute__((target("avx2")))
+#define MIN_PLUS_TARGET_SSE2 __attribute__((target("sse2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define MIN_PLUS_X86 1
+#define MIN_PLUS_TARGET_AVX2
+#define MIN_PLUS_TARGET_SSE2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace graph {
+
+namespace min_plus {
+
+namespace {
+
+using RelaxRowFunction = void (*)(double*, uint32_t*, const double*, const uint32_t*, size_t, double, uint32_t);
+
+//Branch-free scalar step, also used for the tails of the vector loops
+inline void RelaxCell(double* weights, uint32_t* prev_edges,
+                      const double* through_weights, const uint32_t* through_prev_edges,
+                      size_t index, double weight_from, uint32_t prev_edge_from) {
+    const double candidate = weight_from + through_weights[index];
+    const uint32_t through_prev_edge = through_prev_edges[index];
+    const uint32_t candidate_prev_edge = through_prev_edge != NO_EDGE ? through_prev_edge : prev_edge_from;
+    const bool is_shorter = candidate < weights[index];
+    weights[index] = is_shorter ? candidate : weights[index];
+    prev_edges[index] = is_shorter ? candidate_prev_edge : prev_edges[index];
+}
+
+void RelaxRowScalar(double* weights, uint32_t* prev_edges,
+                    const double* through_weights, const uint32_t* through_prev_edges,
+                    size_t count, double weight_from, uint32_t prev_edge_from) {
+    for (size_t index = 0; index < count; ++index) {
+        RelaxCell(weights, prev_edges, through_weights, through_prev_edges, index, weight_from, prev_edge_from);
+    }
+}
+
+#ifdef MIN_PLUS_X86
+
+MIN_PLUS_TARGET_SSE2
+void RelaxRowSse2(double* weights, uint32_t* prev_edges,
+                  const double* through_weights, const uint32_t* through_prev_edges,
+                  size_t count, double weight_from, uint32_t prev_edge_from) {
+    const __m128d weight_from_2 = _mm_set1_pd(weight_from);
+    const __m128i prev_edge_from_2 = _mm_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m128i no_edge_2 = _mm_set1_epi32(-1);
+    size_t index = 0;
+    for (; index + 2 <= count; index += 2) {
+        const __m128d candidate = _mm_add_pd(weight_from_2, _mm_loadu_pd(through_weights + index));
+        const __m128d current = _mm_loadu_pd(weights + index);
+        const __m128d is_shorter = _mm_cmplt_pd(candidate, current);
+        _mm_storeu_pd(weights + index, _mm_or_pd(_mm_and_pd(is_shorter, candidate),
+                                                 _mm_andnot_pd(is_shorter, current)));
+
+        const __m128i through_prev = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(through_prev_edges + index));
+        const __m128i has_no_edge = _mm_cmpeq_epi32(through_prev, no_edge_2);
+        const __m128i candidate_prev = _mm_or_si128(_mm_and_si128(has_no_edge, prev_edge_from_2),
+                                                    _mm_andnot_si128(has_no_edge, through_prev));
+        //Two 64-bit lane masks narrowed to the two low 32-bit lanes
+        const __m128i is_shorter_32 = _mm_shuffle_epi32(_mm_castpd_si128(is_shorter), _MM_SHUFFLE(3, 3, 2, 0));
+        const __m128i current_prev = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(prev_edges + index));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(prev_edges + index),
+                         _mm_or_si128(_mm_and_si128(is_shorter_32, candidate_prev),
+                                      _mm_andnot_si128(is_shorter_32, current_prev)));
+    }
+    for (; index < count; ++index) {
+        RelaxCell(weights, prev_edges, through_weights, through_prev_edges, index, weight_from, prev_edge_from);
+    }
+}
+
+MIN_PLUS_TARGET_AVX2
+void RelaxRowAvx2(double* weights, uint32_t* prev_edges,
+                  const double* through_weights, const uint32_t* through_prev_edges,
+                  size_t count, double weight_from, uint32_t prev_edge_from) {
+    const __m256d weight_from_4 = _mm256_set1_pd(weight_from);
+    const __m128i prev_edge_from_4 = _mm_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m128i no_edge_4 = _mm_set1_epi32(-1);
+    size_t index = 0;
+    for (; index + 4 <= count; index += 4) {
+        const __m256d candidate = _mm256_add_pd(weight_from_4, _mm256_loadu_pd(through_weights + index));
+        const __m256d current = _mm256_loadu_pd(weights + index);
+        const __m256d is_shorter = _mm256_cmp_pd(candidate, current, _CMP_LT_OQ);
+        _mm256_storeu_pd(weights + index, _mm256_blendv_pd(current, candidate, is_shorter));
+
+        const __m128i through_prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(through_prev_edges + index));
+        const __m128i candidate_prev = _mm_blendv_epi8(through_prev, prev_edge_from_4,
+                                                       _mm_cmpeq_epi32(through_prev, no_edge_4));
+        //Four 64-bit lane masks narrowed to four 32-bit lanes
+        const __m128 is_shorter_low = _mm_castpd_ps(_mm256_castpd256_pd128(is_shorter));
+        const __m128 is_shorter_high = _mm_castpd_ps(_mm256_extractf128_pd(is_shorter, 1));
+        const __m128i is_shorter_32 = _mm_castps_si128(_mm_shuffle_ps(is_shorter_low, is_shorter_high,
+                                                                      _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i current_prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev_edges + index));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(prev_edges + index),
+                         _mm_blendv_epi8(current_prev, candidate_prev, is_shorter_32));
+    }
+    for (; index < count; ++index) {
+        RelaxCell(weights, prev_edges, through_weights, through_prev_edges, index, weight_from, prev_edge_from);
+    }
+}
+
+bool IsAvx2Supported() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int cpu_info[4];
+    __cpuid(cpu_info, 0);
+    if (cpu_info[0] < 7) {
+        return false;
+    }
+    __cpuidex(cpu_info, 7, 0);
+    const bool has_avx2 = (cpu_info[1] & (1 << 5)) != 0;
+    __cpuid(cpu_info, 1);
+    const bool has_osxsave = (cpu_info[2] & (1 << 27)) != 0;
+    return has_avx2 && has_osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool IsSse2Supported() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return true;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+RelaxRowFunction GetRelaxRowFunction() {
+    static const RelaxRowFunction function = []() -> RelaxRowFunction {
+#ifdef MIN_PLUS_X86
+        if (IsAvx2Supported()) {
+            return RelaxRowAvx2;
+        }
+        if (IsSse2Supported()) {
+            return RelaxRowSse2;
+        }
+#endif
+        return RelaxRowScalar;
+    }();
+    return function;
+}
+
+}  // namespace
+
+void RelaxRow(double* weights, uint32_t* prev_edges,
+              const double* through_weights, const uint32_t* through_prev_edges,
+              size_t count, double weight_from, uint32_t prev_edge_from) {
+    GetRelaxRowFunction()(weights, prev_edges, through_weights, through_prev_edges,
+                          count, weight_from, prev_edge_from);
+}
+
+}  // namespace min_plus
+
+}  // namespace graph
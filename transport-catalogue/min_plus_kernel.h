@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace graph {
+
+namespace min_plus {
+
+// Predecessor value of cells that have no previous edge
+inline constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+// Min-plus update of one matrix row through a vertex, for every i in [0, count):
+//     candidate = weight_from + through_weights[i]
+//     if candidate < weights[i]:
+//         weights[i] = candidate
+//         prev_edges[i] = through_prev_edges[i] != NO_EDGE ? through_prev_edges[i] : prev_edge_from
+// Unreachable cells hold +infinity, so they never win a comparison. The row may alias the through row.
+// The widest implementation supported by the running CPU (AVX2, SSE2 or scalar) is picked on first call
+void RelaxRow(double* weights, uint32_t* prev_edges,
+              const double* through_weights, const uint32_t* through_prev_edges,
+              size_t count, double weight_from, uint32_t prev_edge_from);
+
+}  // namespace min_plus
+
+}  // namespace graph
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <iterator>
 #include <string_view>
 #include <unordered_map>
@@ -31,6 +32,50 @@ private:
 
 };
 
+// Iterator over consecutive integer values, e.g. ids of a contiguous block of elements
+template <typename T>
+class CountingIterator {
+public:
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = T;
+
+    explicit CountingIterator(T value)
+        : value_(value) {
+    }
+    T operator*() const {
+        return value_;
+    }
+    CountingIterator& operator++() {
+        ++value_;
+        return *this;
+    }
+    CountingIterator operator++(int) {
+        CountingIterator result(*this);
+        ++value_;
+        return result;
+    }
+    bool operator==(const CountingIterator& other) const {
+        return value_ == other.value_;
+    }
+    bool operator!=(const CountingIterator& other) const {
+        return value_ != other.value_;
+    }
+
+private:
+
+    T value_;
+
+};
+
+template <typename T>
+auto AsCountingRange(T begin, T end) {
+    return Range{CountingIterator<T>(begin), CountingIterator<T>(end)};
+}
+
 template <typename C>
 auto AsRange(const C& container) {
     return Range{container.begin(), container.end()};
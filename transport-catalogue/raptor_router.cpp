@@ -0,0 +1,249 @@
+#include "raptor_router.h"
+#include "transport_router.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+RaptorRouter::RaptorRouter(const TransportCatalogue& catalogue,
+	                       const std::set<std::string_view>& route_names,
+	                       const std::set<std::string_view>& stop_names,
+	                       double bus_wait_time_min,
+	                       double bus_velocity_kmph)
+	: bus_wait_time_(bus_wait_time_min)
+	, pattern_offsets_{ 0 }
+{
+	std::unordered_map<std::string_view, uint32_t> stop_ids;
+	for (const auto stop : stop_names) {
+		stop_ids.emplace(stop, static_cast<uint32_t>(stop_ids.size()));
+	}
+	std::unordered_map<std::string_view, uint32_t> route_ids;
+	for (const auto route : route_names) {
+		route_ids.emplace(route, static_cast<uint32_t>(route_ids.size()));
+	}
+	for (const auto& bus : catalogue.GetRoutes()) {
+		const uint32_t route = route_ids.at(bus.route_name);
+		AddPattern(catalogue, bus.route_stops, route, stop_ids, bus_velocity_kmph);
+		if (bus.route_type == RouteType::LINER_ROUTE) {
+			const std::vector<Stop*> reverse_stops(bus.route_stops.rbegin(), bus.route_stops.rend());
+			AddPattern(catalogue, reverse_stops, route, stop_ids, bus_velocity_kmph);
+		}
+	}
+	BuildStopPatterns(stop_names.size());
+}
+
+void RaptorRouter::AddPattern(const TransportCatalogue& catalogue, const std::vector<Stop*>& stops, uint32_t route,
+	                          const std::unordered_map<std::string_view, uint32_t>& stop_ids, double bus_velocity_kmph) {
+	for (size_t index = 0; index < stops.size(); ++index) {
+		pattern_stops_.push_back(stop_ids.at(stops[index]->stop_name));
+		segment_times_.push_back(index == 0 ? 0.0
+			: CalculateTime(catalogue.GetDistanceBetweenTwoStops(stops[index - 1], stops[index]), bus_velocity_kmph));
+	}
+	pattern_offsets_.push_back(pattern_stops_.size());
+	pattern_routes_.push_back(route);
+}
+
+void RaptorRouter::BuildStopPatterns(size_t stops_count) {
+	stop_offsets_.assign(stops_count + 1, 0);
+	for (const uint32_t stop : pattern_stops_) {
+		++stop_offsets_[stop + 1];
+	}
+	for (size_t stop = 0; stop < stops_count; ++stop) {
+		stop_offsets_[stop + 1] += stop_offsets_[stop];
+	}
+	stop_patterns_.resize(pattern_stops_.size());
+	std::vector<size_t> positions(stop_offsets_.begin(), stop_offsets_.end() - 1);
+	for (uint32_t pattern = 0; pattern + 1 < pattern_offsets_.size(); ++pattern) {
+		for (size_t index = pattern_offsets_[pattern]; index < pattern_offsets_[pattern + 1]; ++index) {
+			const uint32_t position = static_cast<uint32_t>(index - pattern_offsets_[pattern]);
+			stop_patterns_[positions[pattern_stops_[index]]++] = { pattern, position };
+		}
+	}
+}
+
+std::optional<RaptorRouter::Route> RaptorRouter::BuildRoute(uint32_t stop_from, uint32_t stop_to) const {
+	const Rounds rounds = Search(stop_from, stop_to);
+	if (rounds.arrivals.back()[stop_to] == INFINITE_TIME) {
+		return std::nullopt;
+	}
+	return RestoreRoute(rounds, stop_from, stop_to);
+}
+
+std::vector<RaptorRouter::Arrival> RaptorRouter::BuildRoutesFrom(uint32_t stop_from) const {
+	const Rounds rounds = Search(stop_from, std::nullopt);
+	const size_t last_round = rounds.arrivals.size() - 1;
+	std::vector<Arrival> result(rounds.arrivals.back().size());
+	for (uint32_t stop = 0; stop < result.size(); ++stop) {
+		const double time = rounds.arrivals[last_round][stop];
+		if (time != INFINITE_TIME) {
+			result[stop] = { time, static_cast<int>(FindImprovingRound(rounds, stop, last_round)) };
+		}
+	}
+	return result;
+}
+
+//Directions are scanned from their last improved stop towards the first one: a stop gets the time of boarding there
+//and leaving the bus at a later stop improved in the previous round. Only the best labels are kept, no route is restored
+std::vector<RaptorRouter::Arrival> RaptorRouter::BuildRoutesTo(uint32_t stop_to) const {
+	const size_t stops_count = stop_offsets_.size() - 1;
+	const size_t patterns_count = pattern_routes_.size();
+	if (stop_to >= stops_count) {
+		throw std::out_of_range("Stop id is out of range");
+	}
+	std::vector<double> prev_departures(stops_count, INFINITE_TIME);
+	prev_departures[stop_to] = 0.0;
+	std::vector<double> best_departures = prev_departures;
+	std::vector<int> rides(stops_count, 0);
+
+	std::vector<bool> is_marked(stops_count, false);
+	std::vector<uint32_t> marked_stops{ stop_to };
+	is_marked[stop_to] = true;
+	std::vector<uint32_t> last_positions(patterns_count, 0);
+	std::vector<bool> is_queued(patterns_count, false);
+	std::vector<uint32_t> queued_patterns;
+
+	for (int round = 1; !marked_stops.empty(); ++round) {
+		for (const uint32_t stop : marked_stops) {
+			is_marked[stop] = false;
+			for (size_t index = stop_offsets_[stop]; index < stop_offsets_[stop + 1]; ++index) {
+				const auto [pattern, position] = stop_patterns_[index];
+				if (!is_queued[pattern]) {
+					is_queued[pattern] = true;
+					last_positions[pattern] = position;
+					queued_patterns.push_back(pattern);
+				}
+				last_positions[pattern] = std::max(last_positions[pattern], position);
+			}
+		}
+		marked_stops.clear();
+
+		std::vector<double> round_departures = prev_departures;
+		for (const uint32_t pattern : queued_patterns) {
+			is_queued[pattern] = false;
+			const size_t offset = pattern_offsets_[pattern];
+			//Time to the destination while riding the bus, leaving it at the best of the later stops
+			double running_time = INFINITE_TIME;
+			for (uint32_t position = last_positions[pattern] + 1; position-- > 0;) {
+				const uint32_t stop = pattern_stops_[offset + position];
+				if (running_time + bus_wait_time_ < best_departures[stop]) {
+					round_departures[stop] = running_time + bus_wait_time_;
+					best_departures[stop] = running_time + bus_wait_time_;
+					rides[stop] = round;
+					if (!is_marked[stop]) {
+						is_marked[stop] = true;
+						marked_stops.push_back(stop);
+					}
+				}
+				running_time = std::min(running_time, prev_departures[stop]) + segment_times_[offset + position];
+			}
+		}
+		queued_patterns.clear();
+		prev_departures = std::move(round_departures);
+	}
+
+	std::vector<Arrival> result(stops_count);
+	for (uint32_t stop = 0; stop < stops_count; ++stop) {
+		if (best_departures[stop] != INFINITE_TIME) {
+			result[stop] = { best_departures[stop], rides[stop] };
+		}
+	}
+	return result;
+}
+
+RaptorRouter::Rounds RaptorRouter::Search(uint32_t stop_from, std::optional<uint32_t> stop_to) const {
+	const size_t stops_count = stop_offsets_.size() - 1;
+	const size_t patterns_count = pattern_routes_.size();
+	if (stop_from >= stops_count || (stop_to && *stop_to >= stops_count)) {
+		throw std::out_of_range("Stop id is out of range");
+	}
+	Rounds rounds{ { std::vector<double>(stops_count, INFINITE_TIME) }, { std::vector<Parent>(stops_count) } };
+	std::vector<double> best_arrivals(stops_count, INFINITE_TIME);
+	rounds.arrivals[0][stop_from] = 0.0;
+	best_arrivals[stop_from] = 0.0;
+
+	std::vector<bool> is_marked(stops_count, false);
+	std::vector<uint32_t> marked_stops{ stop_from };
+	is_marked[stop_from] = true;
+	std::vector<uint32_t> first_positions(patterns_count, std::numeric_limits<uint32_t>::max());
+	std::vector<uint32_t> queued_patterns;
+
+	while (!marked_stops.empty()) {
+		const std::vector<double>& prev_arrivals = rounds.arrivals.back();
+		std::vector<double> round_arrivals = prev_arrivals;
+		std::vector<Parent> round_parents(stops_count);
+
+		//Every direction is scanned once, from the earliest of its stops improved in the previous round
+		for (const uint32_t stop : marked_stops) {
+			is_marked[stop] = false;
+			for (size_t index = stop_offsets_[stop]; index < stop_offsets_[stop + 1]; ++index) {
+				const auto [pattern, position] = stop_patterns_[index];
+				if (first_positions[pattern] == std::numeric_limits<uint32_t>::max()) {
+					queued_patterns.push_back(pattern);
+				}
+				first_positions[pattern] = std::min(first_positions[pattern], position);
+			}
+		}
+		marked_stops.clear();
+
+		for (const uint32_t pattern : queued_patterns) {
+			const size_t offset = pattern_offsets_[pattern];
+			const uint32_t length = static_cast<uint32_t>(pattern_offsets_[pattern + 1] - offset);
+			double running_time = INFINITE_TIME;
+			uint32_t board_position = 0;
+			for (uint32_t position = std::exchange(first_positions[pattern], std::numeric_limits<uint32_t>::max());
+				 position < length; ++position) {
+				const uint32_t stop = pattern_stops_[offset + position];
+				running_time += segment_times_[offset + position];
+				//Arrivals beyond the best known time at the destination can't be a part of the answer
+				const bool is_pruned = stop_to && !(running_time < best_arrivals[*stop_to]);
+				if (running_time < best_arrivals[stop] && !is_pruned) {
+					round_arrivals[stop] = running_time;
+					best_arrivals[stop] = running_time;
+					round_parents[stop] = { pattern, board_position, position };
+					if (!is_marked[stop]) {
+						is_marked[stop] = true;
+						marked_stops.push_back(stop);
+					}
+				}
+				if (prev_arrivals[stop] + bus_wait_time_ < running_time) {
+					running_time = prev_arrivals[stop] + bus_wait_time_;
+					board_position = position;
+				}
+			}
+		}
+		queued_patterns.clear();
+		rounds.arrivals.push_back(std::move(round_arrivals));
+		rounds.parents.push_back(std::move(round_parents));
+	}
+	return rounds;
+}
+
+//The round the arrival at the stop was set in, later rounds only copy it
+size_t RaptorRouter::FindImprovingRound(const Rounds& rounds, uint32_t stop, size_t round) const {
+	while (round > 0 && rounds.arrivals[round - 1][stop] == rounds.arrivals[round][stop]) {
+		--round;
+	}
+	return round;
+}
+
+//Walks the rides back from the destination, each one starts where the previous round ended
+RaptorRouter::Route RaptorRouter::RestoreRoute(const Rounds& rounds, uint32_t stop_from, uint32_t stop_to) const {
+	size_t round = rounds.arrivals.size() - 1;
+	Route route{ rounds.arrivals[round][stop_to], {} };
+	uint32_t stop = stop_to;
+	while (stop != stop_from) {
+		round = FindImprovingRound(rounds, stop, round);
+		const Parent& parent = rounds.parents[round][stop];
+		const size_t offset = pattern_offsets_[parent.pattern];
+		double ride_time = 0.0;
+		for (uint32_t position = parent.board_position + 1; position <= parent.alight_position; ++position) {
+			ride_time += segment_times_[offset + position];
+		}
+		stop = pattern_stops_[offset + parent.board_position];
+		route.legs.push_back({ stop, pattern_routes_[parent.pattern],
+			                   static_cast<int>(parent.alight_position - parent.board_position), ride_time });
+		--round;
+	}
+	std::reverse(route.legs.begin(), route.legs.end());
+	return route;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "transport_catalogue.h"
+
+// Round-based route search (RAPTOR) straight over the bus stop sequences, no graph is built.
+// Round k finds the best arrival at every stop using at most k buses: every direction of a bus passing
+// a stop improved in round k - 1 is scanned once from that stop. Every boarding costs the wait time
+class RaptorRouter {
+public:
+
+	// Ride on one bus: boarded at board_stop, left after span_count stops
+	struct Leg {
+		uint32_t board_stop;
+		uint32_t route;
+		int span_count;
+		double ride_time;
+	};
+
+	struct Route {
+		double total_time;
+		std::vector<Leg> legs;
+	};
+
+	// Best arrival at a stop and the number of buses taken, no time if the stop can't be reached
+	struct Arrival {
+		std::optional<double> time;
+		int rides = 0;
+	};
+
+	// Stops and buses are numbered in the order of the given name sets
+	RaptorRouter(const TransportCatalogue&,
+		         const std::set<std::string_view>& route_names,
+		         const std::set<std::string_view>& stop_names,
+		         double bus_wait_time_min,
+		         double bus_velocity_kmph);
+
+	std::optional<Route> BuildRoute(uint32_t stop_from, uint32_t stop_to) const;
+	std::vector<Arrival> BuildRoutesFrom(uint32_t stop_from) const;
+	// Same rounds run backwards: the time of every stop is the best route from it to stop_to
+	std::vector<Arrival> BuildRoutesTo(uint32_t stop_to) const;
+
+private:
+
+	static constexpr double INFINITE_TIME = std::numeric_limits<double>::infinity();
+	static constexpr uint32_t NO_PATTERN = std::numeric_limits<uint32_t>::max();
+
+	// Position of a stop inside one bus direction
+	struct PatternStop {
+		uint32_t pattern;
+		uint32_t position;
+	};
+
+	// How the best arrival at a stop in some round was reached
+	struct Parent {
+		uint32_t pattern = NO_PATTERN;
+		uint32_t board_position = 0;
+		uint32_t alight_position = 0;
+	};
+
+	// Labels of all rounds of one search: arrivals[k][stop] is the best arrival using at most k buses
+	struct Rounds {
+		std::vector<std::vector<double>> arrivals;
+		std::vector<std::vector<Parent>> parents;
+	};
+
+	double bus_wait_time_ = 0;
+
+	// Bus directions in CSR form: stops of pattern p are pattern_stops_[pattern_offsets_[p], pattern_offsets_[p + 1])
+	std::vector<size_t> pattern_offsets_;
+	std::vector<uint32_t> pattern_stops_;
+	std::vector<double> segment_times_; // ride time from the previous stop of the pattern, zero at the first one
+	std::vector<uint32_t> pattern_routes_;
+
+	// Directions passing every stop, also in CSR form
+	std::vector<size_t> stop_offsets_;
+	std::vector<PatternStop> stop_patterns_;
+
+	void AddPattern(const TransportCatalogue&, const std::vector<Stop*>& stops, uint32_t route,
+		            const std::unordered_map<std::string_view, uint32_t>& stop_ids, double bus_velocity_kmph);
+	void BuildStopPatterns(size_t stops_count);
+
+	// Arrivals no better than the best one at stop_to are pruned, without it every stop is searched
+	Rounds Search(uint32_t stop_from, std::optional<uint32_t> stop_to) const;
+	size_t FindImprovingRound(const Rounds& rounds, uint32_t stop, size_t round) const;
+	Route RestoreRoute(const Rounds& rounds, uint32_t stop_from, uint32_t stop_to) const;
+
+};
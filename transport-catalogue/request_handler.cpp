@@ -28,8 +28,22 @@ void RequestHandler::BuildGraph() {
     std::set<std::string_view> stop_names = std::move(catalogue_.GetStopNames());
     std::set<std::string_view> route_names = std::move(catalogue_.GetRouteNames());
     builder_.BuildGraph(catalogue_, route_names, stop_names);
-    auto router = std::make_unique<RouteBuilder::TcRouter>(builder_.GetRouteGraph());
-    builder_.SetRouter(std::move(router));
+    builder_.BuildRouter();
+}
+
+//Graph of a patched catalogue, routes the patch can't change are taken from the builder of the previous version
+void RequestHandler::PatchGraph(const RouteBuilder& previous) {
+    std::set<std::string_view> stop_names = std::move(catalogue_.GetStopNames());
+    std::set<std::string_view> route_names = std::move(catalogue_.GetRouteNames());
+    builder_.BuildGraph(catalogue_, route_names, stop_names);
+    builder_.RepairRouter(previous);
+}
+
+//Route builder read from the database gets its lookup tables from the catalogue
+void RequestHandler::PrepareRouteBuilder() {
+    std::set<std::string_view> stop_names = catalogue_.GetStopNames();
+    std::set<std::string_view> route_names = catalogue_.GetRouteNames();
+    builder_.PrepareForRequests(catalogue_, route_names, stop_names);
 }
 
 void RequestHandler::SetRender(MapRender& render) {
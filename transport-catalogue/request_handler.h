@@ -21,6 +21,8 @@ public:
 	std::string RenderMap();
 
 	void BuildGraph();
+	void PatchGraph(const RouteBuilder& previous);
+	void PrepareRouteBuilder();
 
 	void SetRender(MapRender& render);
 
@@ -1,35 +1,181 @@
 #pragma once
 
+#include "array_storage.h"
 #include "graph.h"
+#include "lru_cache.h"
+#include "min_plus_kernel.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <queue>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace graph {
 
+// Maps an edge weight onto the value the router compares and accumulates.
+// The comparable value has to be arithmetic: unreachable routes are marked with Infinity()
+template <typename Weight>
+struct WeightTraits {
+    using Comparable = Weight;
+
+    static Comparable ToComparable(const Weight& weight) {
+        return weight;
+    }
+
+    static Weight FromComparable(const Comparable& value) {
+        return value;
+    }
+
+    // Integral weights keep headroom so that adding two of them never overflows
+    static constexpr Comparable Infinity() {
+        if constexpr (std::numeric_limits<Comparable>::has_infinity) {
+            return std::numeric_limits<Comparable>::infinity();
+        }
+        else {
+            return std::numeric_limits<Comparable>::max() / 2;
+        }
+    }
+};
+
 template <typename Weight>
 class Router {
 private:
 
     using Graph = DirectedWeightedGraph<Weight>;
+    using Traits = WeightTraits<Weight>;
 
 public:
 
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
+    using Comparable = typename Traits::Comparable;
+    using PackedEdgeId = uint32_t;
+
+    static_assert(std::is_arithmetic_v<Comparable>, "Router needs an arithmetic comparable weight");
+
+    static constexpr PackedEdgeId NO_EDGE = min_plus::NO_EDGE;
+    static constexpr Comparable INFINITE_WEIGHT = Traits::Infinity();
+
+    // Row-major routes matrix kept as separate weight and predecessor arrays,
+    // unreachable routes hold INFINITE_WEIGHT. The arrays may be borrowed from a mapped database
+    class RoutesInternalData {
+    public:
+
+        RoutesInternalData() = default;
+        explicit RoutesInternalData(size_t vertex_count)
+            : RoutesInternalData(vertex_count, vertex_count) {
+        }
+        RoutesInternalData(size_t row_count, size_t vertex_count)
+            : vertex_count_(vertex_count)
+            , weights_(row_count * vertex_count, INFINITE_WEIGHT)
+            , prev_edges_(row_count * vertex_count, NO_EDGE) {
+        }
+
+        // Takes ready arrays of vertex_count * vertex_count values
+        RoutesInternalData(size_t vertex_count, std::vector<Comparable> weights, std::vector<PackedEdgeId> prev_edges)
+            : vertex_count_(vertex_count)
+            , weights_(std::move(weights))
+            , prev_edges_(std::move(prev_edges)) {
+            if (weights_.GetSize() != vertex_count * vertex_count || prev_edges_.GetSize() != weights_.GetSize()) {
+                throw std::invalid_argument("Routes arrays don't match the vertex count");
+            }
+        }
+
+        // Both arrays hold vertex_count * vertex_count values and have to outlive the matrix
+        static RoutesInternalData Borrow(size_t vertex_count, const Comparable* weights, const PackedEdgeId* prev_edges) {
+            RoutesInternalData data;
+            data.vertex_count_ = vertex_count;
+            data.weights_ = ArrayStorage<Comparable>::Borrow(weights, vertex_count * vertex_count);
+            data.prev_edges_ = ArrayStorage<PackedEdgeId>::Borrow(prev_edges, vertex_count * vertex_count);
+            return data;
+        }
+
+        size_t GetVertexCount() const {
+            return vertex_count_;
+        }
+
+        bool IsReachable(VertexId from, VertexId to) const {
+            return GetWeight(from, to) < INFINITE_WEIGHT;
+        }
+
+        const Comparable& GetWeight(VertexId from, VertexId to) const {
+            return weights_[from * vertex_count_ + to];
+        }
+
+        PackedEdgeId GetPackedPrevEdge(VertexId from, VertexId to) const {
+            return prev_edges_[from * vertex_count_ + to];
+        }
+
+        std::optional<EdgeId> GetPrevEdge(VertexId from, VertexId to) const {
+            const PackedEdgeId prev_edge = GetPackedPrevEdge(from, to);
+            if (prev_edge == NO_EDGE) {
+                return std::nullopt;
+            }
+            return prev_edge;
+        }
+
+        void Set(VertexId from, VertexId to, const Comparable& weight, std::optional<EdgeId> prev_edge) {
+            SetPacked(from, to, weight, prev_edge ? static_cast<PackedEdgeId>(*prev_edge) : NO_EDGE);
+        }
+
+        void SetPacked(VertexId from, VertexId to, const Comparable& weight, PackedEdgeId prev_edge) {
+            const size_t index = from * vertex_count_ + to;
+            weights_.GetOwned()[index] = weight;
+            prev_edges_.GetOwned()[index] = prev_edge;
+        }
+
+        Comparable* GetWeightsRow(VertexId from) {
+            return weights_.GetOwned().data() + from * vertex_count_;
+        }
+
+        const Comparable* GetWeightsRow(VertexId from) const {
+            return weights_.GetData() + from * vertex_count_;
+        }
+
+        PackedEdgeId* GetPrevEdgesRow(VertexId from) {
+            return prev_edges_.GetOwned().data() + from * vertex_count_;
+        }
+
+        const PackedEdgeId* GetPrevEdgesRow(VertexId from) const {
+            return prev_edges_.GetData() + from * vertex_count_;
+        }
+
+        const ArrayStorage<Comparable>& GetWeights() const {
+            return weights_;
+        }
+
+        const ArrayStorage<PackedEdgeId>& GetPrevEdges() const {
+            return prev_edges_;
+        }
+
+    private:
+
+        size_t vertex_count_ = 0;
+        ArrayStorage<Comparable> weights_;
+        ArrayStorage<PackedEdgeId> prev_edges_;
+
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
 
     Router() = default;
     explicit Router(const Graph& graph);
+    Router(const Graph& graph, ThreadPool& thread_pool);
+
+    // Routes matrix of a changed graph repaired from the matrix of its previous version. vertex_map and edge_map give
+    // the new id of every previous vertex and edge, none for the removed ones; new edges nothing maps to are the added ones.
+    // A row keeps the routes whose tree path is whole, a Dijkstra seeded with them and the added edges finds the rest,
+    // so a small change costs a search over the part of the graph it touches
+    Router(const Graph& graph, const Graph& previous_graph, const RoutesInternalData& previous_data,
+           const std::vector<std::optional<VertexId>>& vertex_map, const std::vector<std::optional<EdgeId>>& edge_map,
+           ThreadPool& thread_pool);
 
     struct RouteInfo {
         Weight weight;
@@ -52,47 +198,190 @@ public:
 
 private:
 
+    // Side of a square tile of the blocked Floyd-Warshall
+    static constexpr size_t TILE_SIZE = 64;
+
+    // Range of vertices covered by one tile side
+    struct TileRange {
+        VertexId begin;
+        VertexId end;
+    };
+
+    // Rows and columns of the current phase's through-block as they were when their own relaxation step began.
+    // Row k of through_rows holds (k, *), row k of through_columns holds (*, k) transposed
+    struct PhaseSnapshot {
+        RoutesInternalData through_rows;
+        RoutesInternalData through_columns;
+    };
+
     void InitializeRoutesInternalData(const Graph& graph) {
         const size_t vertex_count = graph.GetVertexCount();
+        if (graph.GetEdgeCount() >= NO_EDGE) {
+            throw std::length_error("Too many edges for the routes matrix");
+        }
         for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
+            routes_internal_data_.Set(vertex, vertex, ZERO_WEIGHT, std::nullopt);
             for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                 const auto& edge = graph.GetEdge(edge_id);
-                if (edge.weight < ZERO_WEIGHT) {
+                const Comparable edge_weight = Traits::ToComparable(edge.weight);
+                if (edge_weight < ZERO_WEIGHT) {
                     throw std::domain_error("Edges' weights should be non-negative");
                 }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                    route_internal_data = RouteInternalData{edge.weight, edge_id};
+                if (routes_internal_data_.GetWeight(vertex, edge.to) > edge_weight) {
+                    routes_internal_data_.Set(vertex, edge.to, edge_weight, edge_id);
                 }
             }
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, 
-                    const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
+    // Relaxes cells (from, columns) through a vertex: weight_from and prev_edge_from describe the route
+    // (from, through), row through_row of through_data holds the routes (through, columns).
+    // Double weights go to the vectorized kernel, others take the same branch-free loop
+    void RelaxRowThroughVertex(VertexId from, TileRange columns,
+                               const Comparable& weight_from, PackedEdgeId prev_edge_from,
+                               const RoutesInternalData& through_data, VertexId through_row) {
+        Comparable* weights = routes_internal_data_.GetWeightsRow(from) + columns.begin;
+        PackedEdgeId* prev_edges = routes_internal_data_.GetPrevEdgesRow(from) + columns.begin;
+        const Comparable* through_weights = through_data.GetWeightsRow(through_row) + columns.begin;
+        const PackedEdgeId* through_prev_edges = through_data.GetPrevEdgesRow(through_row) + columns.begin;
+        const size_t count = columns.end - columns.begin;
+        if constexpr (std::is_same_v<Comparable, double>) {
+            min_plus::RelaxRow(weights, prev_edges, through_weights, through_prev_edges,
+                               count, weight_from, prev_edge_from);
+        }
+        else {
+            for (size_t index = 0; index < count; ++index) {
+                const Comparable candidate_weight = weight_from + through_weights[index];
+                const PackedEdgeId candidate_prev_edge = through_prev_edges[index] != NO_EDGE ? through_prev_edges[index]
+                                                                                              : prev_edge_from;
+                const bool is_shorter = candidate_weight < weights[index];
+                weights[index] = is_shorter ? candidate_weight : weights[index];
+                prev_edges[index] = is_shorter ? candidate_prev_edge : prev_edges[index];
+            }
         }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-                    }
+    // Relaxation steps of the block's vertices, in order, for a tile whose rows or columns overlap the block.
+    // Since routes never get shorter through their own end vertex, row and column k are final during step k,
+    // which is when they are copied to the snapshot for the tiles processed later in the phase
+    void RelaxBlockTile(TileRange block, TileRange rows, TileRange columns, PhaseSnapshot& snapshot) {
+        auto& data = routes_internal_data_;
+        const bool is_block_row = rows.begin == block.begin;
+        const bool is_block_column = columns.begin == block.begin;
+        for (VertexId through = block.begin; through < block.end; ++through) {
+            const VertexId step = through - block.begin;
+            if (is_block_row) {
+                for (VertexId to = columns.begin; to < columns.end; ++to) {
+                    snapshot.through_rows.SetPacked(step, to, data.GetWeight(through, to),
+                                                    data.GetPackedPrevEdge(through, to));
                 }
             }
+            if (is_block_column) {
+                for (VertexId from = rows.begin; from < rows.end; ++from) {
+                    snapshot.through_columns.SetPacked(step, from, data.GetWeight(from, through),
+                                                       data.GetPackedPrevEdge(from, through));
+                }
+            }
+            const auto& through_data = is_block_row ? data : snapshot.through_rows;
+            const VertexId through_row = is_block_row ? through : step;
+            for (VertexId from = rows.begin; from < rows.end; ++from) {
+                const auto& column_data = is_block_column ? data : snapshot.through_columns;
+                const VertexId column_row = is_block_column ? from : step;
+                const VertexId column_to = is_block_column ? through : from;
+                if (column_data.IsReachable(column_row, column_to)) {
+                    RelaxRowThroughVertex(from, columns,
+                                          column_data.GetWeight(column_row, column_to),
+                                          column_data.GetPackedPrevEdge(column_row, column_to),
+                                          through_data, through_row);
+                }
+            }
+        }
+    }
+
+    // Tiles sharing neither rows nor columns with the block read the block only from the snapshot,
+    // so each of their rows goes through all steps of the phase at once
+    void RelaxOuterTile(TileRange block, TileRange rows, TileRange columns, const PhaseSnapshot& snapshot) {
+        for (VertexId from = rows.begin; from < rows.end; ++from) {
+            for (VertexId through = block.begin; through < block.end; ++through) {
+                const VertexId step = through - block.begin;
+                if (snapshot.through_columns.IsReachable(step, from)) {
+                    RelaxRowThroughVertex(from, columns,
+                                          snapshot.through_columns.GetWeight(step, from),
+                                          snapshot.through_columns.GetPackedPrevEdge(step, from),
+                                          snapshot.through_rows, step);
+                }
+            }
+        }
+    }
+
+    // Blocked Floyd-Warshall: each phase relaxes through one block of TILE_SIZE vertices, first in the
+    // diagonal tile, then in the tiles of the block's rows and columns, then in all remaining tiles.
+    // Every cell meets the same candidates in the same order as in the plain triple loop, so the result is identical
+    void RelaxRoutesInternalData(size_t vertex_count, ThreadPool& thread_pool) {
+        const size_t tile_count = (vertex_count + TILE_SIZE - 1) / TILE_SIZE;
+        const auto get_tile = [vertex_count](size_t index) {
+            return TileRange{index * TILE_SIZE, std::min(vertex_count, (index + 1) * TILE_SIZE)};
+        };
+        for (size_t block_index = 0; block_index < tile_count; ++block_index) {
+            const TileRange block = get_tile(block_index);
+            PhaseSnapshot snapshot{RoutesInternalData(TILE_SIZE, vertex_count),
+                                   RoutesInternalData(TILE_SIZE, vertex_count)};
+
+            RelaxBlockTile(block, block, block, snapshot);
+
+            thread_pool.ParallelFor(2 * tile_count, [&](size_t task) {
+                const size_t tile_index = task / 2;
+                if (tile_index == block_index) {
+                    return;
+                }
+                if (task % 2 == 0) {
+                    RelaxBlockTile(block, block, get_tile(tile_index), snapshot);
+                }
+                else {
+                    RelaxBlockTile(block, get_tile(tile_index), block, snapshot);
+                }
+            });
+
+            thread_pool.ParallelFor(tile_count * tile_count, [&](size_t task) {
+                const size_t row_index = task / tile_count;
+                const size_t column_index = task % tile_count;
+                if (row_index == block_index || column_index == block_index) {
+                    return;
+                }
+                RelaxOuterTile(block, get_tile(row_index), get_tile(column_index), snapshot);
+            });
+        }
+    }
+
+    using QueueItem = std::pair<Comparable, VertexId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+
+    // Shortens the route to the edge's target if the edge gives a better one
+    void RelaxEdge(VertexId from, EdgeId edge_id, const Comparable& edge_from_weight, Queue& queue) {
+        const auto& edge = graph_->GetEdge(edge_id);
+        const Comparable candidate_weight = edge_from_weight + Traits::ToComparable(edge.weight);
+        if (candidate_weight < routes_internal_data_.GetWeight(from, edge.to)) {
+            routes_internal_data_.SetPacked(from, edge.to, candidate_weight, static_cast<PackedEdgeId>(edge_id));
+            queue.push({candidate_weight, edge.to});
+        }
+    }
+
+    // Dijkstra over the row whose weights are reachable upper bounds, the queue holds every vertex that may improve
+    // the routes of its neighbours
+    void SettleRow(VertexId from, Queue& queue) {
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > routes_internal_data_.GetWeight(from, vertex)) {
+                continue;
+            }
+            for (const EdgeId edge_id : graph_->GetIncidentEdges(vertex)) {
+                RelaxEdge(from, edge_id, weight, queue);
+            }
         }
     }
 
-    static inline Weight ZERO_WEIGHT{};
+    static inline Comparable ZERO_WEIGHT{};
     const Graph* graph_ = nullptr;
     RoutesInternalData routes_internal_data_;
 
@@ -101,29 +390,139 @@ private:
 template <typename Weight>
 Router<Weight>::Router(const Graph& graph)
     : graph_(&graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+    , routes_internal_data_(graph.GetVertexCount())
 {
     InitializeRoutesInternalData(graph);
+    ThreadPool thread_pool;
+    RelaxRoutesInternalData(graph.GetVertexCount(), thread_pool);
+}
+
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, ThreadPool& thread_pool)
+    : graph_(&graph)
+    , routes_internal_data_(graph.GetVertexCount())
+{
+    InitializeRoutesInternalData(graph);
+    RelaxRoutesInternalData(graph.GetVertexCount(), thread_pool);
+}
 
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, const Graph& previous_graph, const RoutesInternalData& previous_data,
+                       const std::vector<std::optional<VertexId>>& vertex_map,
+                       const std::vector<std::optional<EdgeId>>& edge_map, ThreadPool& thread_pool)
+    : graph_(&graph)
+    , routes_internal_data_(graph.GetVertexCount())
+{
     const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    const size_t previous_vertex_count = previous_graph.GetVertexCount();
+    if (graph.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for the routes matrix");
+    }
+    if (vertex_map.size() != previous_vertex_count || edge_map.size() != previous_graph.GetEdgeCount()
+        || previous_data.GetVertexCount() != previous_vertex_count) {
+        throw std::invalid_argument("Maps don't match the previous graph");
     }
+    std::vector<bool> is_kept_edge(graph.GetEdgeCount(), false);
+    for (const auto& edge_id : edge_map) {
+        if (edge_id) {
+            is_kept_edge.at(*edge_id) = true;
+        }
+    }
+    std::vector<EdgeId> added_edges;
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (Traits::ToComparable(graph.GetEdge(edge_id).weight) < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        if (!is_kept_edge[edge_id]) {
+            added_edges.push_back(edge_id);
+        }
+    }
+    std::vector<std::optional<VertexId>> previous_vertices(vertex_count);
+    for (VertexId vertex = 0; vertex < previous_vertex_count; ++vertex) {
+        if (vertex_map[vertex]) {
+            previous_vertices.at(*vertex_map[vertex]) = vertex;
+        }
+    }
+
+    thread_pool.ParallelFor(vertex_count, [&](size_t from) {
+        Queue queue;
+        const auto previous_from = previous_vertices[from];
+        if (!previous_from) {
+            routes_internal_data_.SetPacked(from, from, ZERO_WEIGHT, NO_EDGE);
+            queue.push({ZERO_WEIGHT, from});
+            SettleRow(from, queue);
+            return;
+        }
+        //A route is cut if its tree path lost an edge. Statuses are found once per vertex along the paths:
+        //-1 not known yet, 0 kept, 1 cut
+        std::vector<int8_t> is_cut(previous_vertex_count, -1);
+        std::vector<VertexId> path;
+        for (VertexId previous_to = 0; previous_to < previous_vertex_count; ++previous_to) {
+            if (!previous_data.IsReachable(*previous_from, previous_to)) {
+                continue;
+            }
+            VertexId vertex = previous_to;
+            while (is_cut[vertex] < 0) {
+                const PackedEdgeId prev_edge = previous_data.GetPackedPrevEdge(*previous_from, vertex);
+                if (prev_edge == NO_EDGE || !edge_map[prev_edge] || path.size() == previous_vertex_count) {
+                    is_cut[vertex] = prev_edge != NO_EDGE;
+                    break;
+                }
+                path.push_back(vertex);
+                vertex = previous_graph.GetEdge(prev_edge).from;
+            }
+            for (const VertexId path_vertex : path) {
+                is_cut[path_vertex] = is_cut[vertex];
+            }
+            path.clear();
+        }
+
+        std::vector<VertexId> cut_vertices;
+        for (VertexId previous_to = 0; previous_to < previous_vertex_count; ++previous_to) {
+            if (!vertex_map[previous_to] || is_cut[previous_to] < 0) {
+                continue;
+            }
+            if (is_cut[previous_to]) {
+                cut_vertices.push_back(*vertex_map[previous_to]);
+                continue;
+            }
+            const PackedEdgeId prev_edge = previous_data.GetPackedPrevEdge(*previous_from, previous_to);
+            routes_internal_data_.SetPacked(from, *vertex_map[previous_to], previous_data.GetWeight(*previous_from, previous_to),
+                                            prev_edge == NO_EDGE ? NO_EDGE : static_cast<PackedEdgeId>(*edge_map[prev_edge]));
+        }
+        //Cut routes start over from the kept ones, an added edge may shorten any route
+        for (const VertexId vertex : cut_vertices) {
+            for (const EdgeId edge_id : graph.GetIncomingEdges(vertex)) {
+                const VertexId edge_from = graph.GetEdge(edge_id).from;
+                if (routes_internal_data_.IsReachable(from, edge_from)) {
+                    RelaxEdge(from, edge_id, routes_internal_data_.GetWeight(from, edge_from), queue);
+                }
+            }
+        }
+        for (const EdgeId edge_id : added_edges) {
+            const VertexId edge_from = graph.GetEdge(edge_id).from;
+            if (routes_internal_data_.IsReachable(from, edge_from)) {
+                RelaxEdge(from, edge_id, routes_internal_data_.GetWeight(from, edge_from), queue);
+            }
+        }
+        SettleRow(from, queue);
+    });
 }
 
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
                                                                              VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+    if (from >= routes_internal_data_.GetVertexCount() || to >= routes_internal_data_.GetVertexCount()) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    if (!routes_internal_data_.IsReachable(from, to)) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+    const Weight weight = Traits::FromComparable(routes_internal_data_.GetWeight(from, to));
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
+    for (std::optional<EdgeId> edge_id = routes_internal_data_.GetPrevEdge(from, to);
          edge_id;
-         edge_id = routes_internal_data_[from][graph_->GetEdge(*edge_id).from]->prev_edge)
+         edge_id = routes_internal_data_.GetPrevEdge(from, graph_->GetEdge(*edge_id).from))
     {
         edges.push_back(*edge_id);
     }
@@ -132,4 +531,129 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(Ver
     return RouteInfo{weight, std::move(edges)};
 }
 
+// Computes a row of the routes matrix, the shortest routes from one vertex, on the first query from that vertex.
+// Rows are kept in an LRU cache within a memory budget, so later queries from the same vertex only walk the route
+template <typename Weight>
+class LazyRouter {
+private:
+
+    using Graph = DirectedWeightedGraph<Weight>;
+    using Traits = WeightTraits<Weight>;
+
+    struct Row;
+    using RowCache = ShardedLruCache<VertexId, std::shared_ptr<const Row>>;
+
+public:
+
+    using Comparable = typename Traits::Comparable;
+    using PackedEdgeId = typename Router<Weight>::PackedEdgeId;
+    using RouteInfo = typename Router<Weight>::RouteInfo;
+
+    static constexpr PackedEdgeId NO_EDGE = Router<Weight>::NO_EDGE;
+    static constexpr Comparable INFINITE_WEIGHT = Router<Weight>::INFINITE_WEIGHT;
+
+    // The cached rows never take more than memory_budget_bytes, except for the one row
+    // that is always kept when even it doesn't fit
+    LazyRouter(const Graph& graph, size_t memory_budget_bytes);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+
+    typename RowCache::Stats GetRowCacheStats() const {
+        return row_cache_->GetStats();
+    }
+
+private:
+
+    struct Row {
+        std::vector<Comparable> weights;
+        std::vector<PackedEdgeId> prev_edges;
+    };
+
+    // A handful of shards: rows are large, so the budget holds few of them
+    static constexpr size_t ROW_CACHE_SHARD_COUNT = 4;
+    static inline Comparable ZERO_WEIGHT{};
+
+    const Graph* graph_ = nullptr;
+    std::unique_ptr<RowCache> row_cache_;
+
+    std::shared_ptr<const Row> GetRow(VertexId from) const;
+    Row ComputeRow(VertexId from) const;
+
+};
+
+template <typename Weight>
+LazyRouter<Weight>::LazyRouter(const Graph& graph, size_t memory_budget_bytes)
+    : graph_(&graph)
+{
+    if (graph.GetEdgeCount() >= NO_EDGE) {
+        throw std::length_error("Too many edges for the routes rows");
+    }
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (Traits::ToComparable(graph.GetEdge(edge_id).weight) < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+    const size_t row_bytes = std::max<size_t>(1, graph.GetVertexCount() * (sizeof(Comparable) + sizeof(PackedEdgeId)));
+    const size_t row_count = std::max<size_t>(1, memory_budget_bytes / row_bytes);
+    row_cache_ = std::make_unique<RowCache>(row_count, ROW_CACHE_SHARD_COUNT);
+}
+
+template <typename Weight>
+std::shared_ptr<const typename LazyRouter<Weight>::Row> LazyRouter<Weight>::GetRow(VertexId from) const {
+    if (auto row = row_cache_->Find(from)) {
+        return std::move(*row);
+    }
+    auto row = std::make_shared<const Row>(ComputeRow(from));
+    row_cache_->Insert(from, row);
+    return row;
+}
+
+// One-to-all Dijkstra over comparable weights
+template <typename Weight>
+typename LazyRouter<Weight>::Row LazyRouter<Weight>::ComputeRow(VertexId from) const {
+    const size_t vertex_count = graph_->GetVertexCount();
+    Row row{std::vector<Comparable>(vertex_count, INFINITE_WEIGHT), std::vector<PackedEdgeId>(vertex_count, NO_EDGE)};
+    using QueueItem = std::pair<Comparable, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    row.weights[from] = ZERO_WEIGHT;
+    queue.push({ZERO_WEIGHT, from});
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weight > row.weights[vertex]) {
+            continue;
+        }
+        for (const EdgeId edge_id : graph_->GetIncidentEdges(vertex)) {
+            const auto& edge = graph_->GetEdge(edge_id);
+            const Comparable candidate_weight = weight + Traits::ToComparable(edge.weight);
+            if (candidate_weight < row.weights[edge.to]) {
+                row.weights[edge.to] = candidate_weight;
+                row.prev_edges[edge.to] = static_cast<PackedEdgeId>(edge_id);
+                queue.push({candidate_weight, edge.to});
+            }
+        }
+    }
+    return row;
+}
+
+template <typename Weight>
+std::optional<typename LazyRouter<Weight>::RouteInfo> LazyRouter<Weight>::BuildRoute(VertexId from,
+                                                                                     VertexId to) const {
+    if (from >= graph_->GetVertexCount() || to >= graph_->GetVertexCount()) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    const std::shared_ptr<const Row> row = GetRow(from);
+    if (!(row->weights[to] < INFINITE_WEIGHT)) {
+        return std::nullopt;
+    }
+    std::vector<EdgeId> edges;
+    for (PackedEdgeId edge_id = row->prev_edges[to]; edge_id != NO_EDGE;
+         edge_id = row->prev_edges[graph_->GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{Traits::FromComparable(row->weights[to]), std::move(edges)};
+}
+
 }  // namespace graph
\ No newline at end of file
@@ -1,5 +1,102 @@
 #include "serialization.h"
 
+#include <cstring>
+#include <numeric>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+namespace {
+
+//Descriptor for protobuf's FileInputStream, which seeks over the skipped sections
+int OpenForReading(const std::filesystem::path& path) {
+#ifdef _WIN32
+    return _wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    return open(path.c_str(), O_RDONLY);
+#endif
+}
+
+//Parses the length-delimited field the stream stands at into a message allocated on the arena
+template <typename Message>
+const Message& ParseSection(google::protobuf::io::CodedInputStream& input, google::protobuf::Arena& arena) {
+    Message* message = google::protobuf::Arena::CreateMessage<Message>(&arena);
+    uint32_t size = 0;
+    if (!input.ReadVarint32(&size) || size > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Damaged section in the database");
+    }
+    const auto limit = input.PushLimit(static_cast<int>(size));
+    if (!message->MergeFromCodedStream(&input) || !input.ConsumedEntireMessage()) {
+        throw std::runtime_error("Damaged section in the database");
+    }
+    input.PopLimit(limit);
+    return *message;
+}
+
+//Position of every edge among the edges entering its target
+std::vector<uint32_t> GetIncomingPositions(const RouteBuilder::RouteGraph& graph) {
+    std::vector<uint32_t> positions(graph.GetEdgeCount());
+    for (graph::VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+        uint32_t position = 0;
+        for (const graph::EdgeId edge_id : graph.GetIncomingEdges(vertex)) {
+            positions[edge_id] = position++;
+        }
+    }
+    return positions;
+}
+
+//Bit patterns of non-negative doubles are ordered like the values, so close values have a small difference
+int64_t GetBitDifference(double value, double prediction) {
+    uint64_t value_bits = 0, prediction_bits = 0;
+    std::memcpy(&value_bits, &value, sizeof(value));
+    std::memcpy(&prediction_bits, &prediction, sizeof(prediction));
+    return static_cast<int64_t>(value_bits - prediction_bits);
+}
+
+double ApplyBitDifference(double prediction, int64_t difference) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &prediction, sizeof(prediction));
+    bits += static_cast<uint64_t>(difference);
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+//ZLIB stream, the format the deflated blocks are written in
+std::string Deflate(const std::string& data) {
+    std::string result;
+    google::protobuf::io::StringOutputStream string_stream(&result);
+    google::protobuf::io::GzipOutputStream::Options options;
+    options.format = google::protobuf::io::GzipOutputStream::ZLIB;
+    google::protobuf::io::GzipOutputStream deflate_stream(&string_stream, options);
+    {
+        google::protobuf::io::CodedOutputStream output(&deflate_stream);
+        output.WriteRaw(data.data(), static_cast<int>(data.size()));
+    }
+    if (!deflate_stream.Close()) {
+        throw std::runtime_error("Can't compress the map");
+    }
+    return result;
+}
+
+std::string Inflate(std::string_view data) {
+    google::protobuf::io::ArrayInputStream array_stream(data.data(), static_cast<int>(data.size()));
+    google::protobuf::io::GzipInputStream inflate_stream(&array_stream, google::protobuf::io::GzipInputStream::ZLIB);
+    std::string result;
+    const void* chunk = nullptr;
+    int chunk_size = 0;
+    while (inflate_stream.Next(&chunk, &chunk_size)) {
+        result.append(static_cast<const char*>(chunk), chunk_size);
+    }
+    if (inflate_stream.ZlibErrorCode() < 0) {
+        throw std::runtime_error("Damaged map in the database");
+    }
+    return result;
+}
+
+}  // namespace
 
 Serializer::Serializer(SerializeSettings settings)
     : settings_(std::move(settings)) {
@@ -13,59 +110,186 @@ void Serializer::SetSettings(const SerializeSettings& settings) {
 
 void Serializer::SaveToFile(TransportCatalogue& catalogue, 
                             const RenderSettings& settings, 
-                            const RouteBuilder& builder) {
-    std::ofstream out_file(settings_.path_to_db, std::ios::binary);
-    *proto_data_.mutable_catalogue() = SerializeCatalogue(catalogue);
-    *proto_data_.mutable_render_settings() = SerializeRenderSettings(settings);
-    *proto_data_.mutable_route_builder() = SerializeCatalogueRouter(builder);
-    proto_data_.SerializeToOstream(&out_file);
+                            const RouteBuilder& builder,
+                            const std::string& map) {
+    std::filesystem::path temporary_path = settings_.path_to_db;
+    temporary_path += ".tmp";
+    std::ofstream out_file(temporary_path, std::ios::binary);
+    if (settings_.format == DatabaseFormat::FLAT) {
+        SaveToFlatFile(catalogue, settings, builder, map, out_file);
+    }
+    else {
+        tc_serialize::CatalogueData proto_data;
+        *proto_data.mutable_catalogue() = SerializeCatalogue(catalogue, builder);
+        *proto_data.mutable_render_settings() = SerializeRenderSettings(settings);
+        *proto_data.mutable_route_builder() = SerializeCatalogueRouter(builder);
+        *proto_data.mutable_map() = SerializeMap(map);
+        //Fields are serialized in the order of their numbers, so the version is put ahead of them by hand
+        google::protobuf::io::OstreamOutputStream raw_output(&out_file);
+        google::protobuf::io::CodedOutputStream output(&raw_output);
+        google::protobuf::internal::WireFormatLite::WriteUInt32(tc_serialize::CatalogueData::kVersionFieldNumber,
+                                                                 DATABASE_VERSION, &output);
+        proto_data.SerializeToCodedStream(&output);
+    }
+    out_file.close();
+    if (!out_file) {
+        throw std::runtime_error("Can't write " + temporary_path.string());
+    }
+    std::filesystem::rename(temporary_path, settings_.path_to_db);
 }
 
-tc_serialize::TransportCatalogue Serializer::SerializeCatalogue(TransportCatalogue& catalogue) const {
-    tc_serialize::TransportCatalogue proto_catalogue;
-    const auto& stops = catalogue.GetStops();
-    const auto& routes = catalogue.GetRoutes();
-    const auto& distances = catalogue.GetDistances();
-    for (const auto& stop : stops) {
-        *proto_catalogue.add_stops() = SerializeStop(stop);
+//Catalogue records and the large router arrays go as they are, the remaining settings as a protobuf section
+void Serializer::SaveToFlatFile(TransportCatalogue& catalogue,
+                                const RenderSettings& settings,
+                                const RouteBuilder& builder,
+                                const std::string& map,
+                                std::ostream& output) {
+    flat_db::Writer writer(sizeof(RouteBuilder::RouteEdge));
+    std::unordered_map<const Stop*, uint32_t> stop_indexes;
+    std::vector<flat_db::StopRecord> stops;
+    for (const auto& stop : catalogue.GetStops()) {
+        stop_indexes.emplace(&stop, static_cast<uint32_t>(stops.size()));
+        stops.push_back({writer.AddName(stop.stop_name), stop.coordinates.lat, stop.coordinates.lng});
     }
-    for (const auto& [stops, distance] : distances) {
-        const auto& [stop_from, stop_to] = stops;
-        *proto_catalogue.add_distances() = SerializeDistance(*stop_from, *stop_to, distance);
+    std::vector<flat_db::BusRecord> buses;
+    std::vector<flat_db::BusStatsRecord> bus_stats;
+    std::vector<uint32_t> bus_stops;
+    for (const auto& route : catalogue.GetRoutes()) {
+        buses.push_back({writer.AddName(route.route_name), bus_stops.size(),
+                         static_cast<uint32_t>(route.route_stops.size()), route.route_type == RouteType::RING_ROUTE});
+        const auto [stop_count, unique_stop_count, route_length, curvature] = *catalogue.GetBusInfo(route.route_name);
+        bus_stats.push_back({stop_count, unique_stop_count, route_length, curvature});
+        for (const Stop* stop : route.route_stops) {
+            bus_stops.push_back(stop_indexes.at(stop));
+        }
     }
-    for (const auto& route : routes) {
-        *proto_catalogue.add_routes() = SerializeBus(route);
+    std::vector<flat_db::DistanceRecord> distances;
+    for (const auto& [stops_pair, distance] : catalogue.GetDistances()) {
+        distances.push_back({stop_indexes.at(stops_pair.first), stop_indexes.at(stops_pair.second), distance});
+    }
+    writer.AddArray(flat_db::SectionKind::STOPS, stops.data(), stops.size());
+    writer.AddArray(flat_db::SectionKind::BUSES, buses.data(), buses.size());
+    writer.AddArray(flat_db::SectionKind::BUS_STOPS, bus_stops.data(), bus_stops.size());
+    writer.AddArray(flat_db::SectionKind::BUS_STATS, bus_stats.data(), bus_stats.size());
+    writer.AddArray(flat_db::SectionKind::DISTANCES, distances.data(), distances.size());
+
+    const std::string render_settings_data = SerializeRenderSettings(settings).SerializeAsString();
+    const std::string route_builder_data = SerializeRouterExtras(builder).SerializeAsString();
+    writer.AddSection(flat_db::SectionKind::RENDER_SETTINGS, render_settings_data.data(), render_settings_data.size());
+    writer.AddSection(flat_db::SectionKind::ROUTE_BUILDER, route_builder_data.data(), route_builder_data.size());
+    const std::string deflated_map = settings_.is_map_compressed ? Deflate(map) : std::string();
+    if (settings_.is_map_compressed) {
+        writer.AddSection(flat_db::SectionKind::DEFLATED_MAP, deflated_map.data(), deflated_map.size());
+    }
+    else {
+        writer.AddSection(flat_db::SectionKind::MAP, map.data(), map.size());
     }
-    return proto_catalogue;
-}
 
-tc_serialize::Stop Serializer::SerializeStop(const Stop& stop) const {
-    tc_serialize::Stop proto_stop;
+    const auto& graph = builder.GetRouteGraph();
+    writer.AddArray(flat_db::SectionKind::GRAPH_EDGES, graph.GetEdges().GetData(), graph.GetEdges().GetSize());
+    writer.AddArray(flat_db::SectionKind::GRAPH_OFFSETS, graph.GetOffsets().GetData(), graph.GetOffsets().GetSize());
+    writer.AddArray(flat_db::SectionKind::GRAPH_INCOMING_OFFSETS, graph.GetIncomingOffsets().GetData(),
+                    graph.GetIncomingOffsets().GetSize());
+    writer.AddArray(flat_db::SectionKind::GRAPH_INCOMING_EDGES, graph.GetIncomingEdgeIds().GetData(),
+                    graph.GetIncomingEdgeIds().GetSize());
+    if (builder.HasRouter()) {
+        const auto& routes_internal_data = builder.GetRouter().GetRoutesInternalData();
+        writer.AddArray(flat_db::SectionKind::ROUTER_WEIGHTS, routes_internal_data.GetWeights().GetData(),
+                        routes_internal_data.GetWeights().GetSize());
+        writer.AddArray(flat_db::SectionKind::ROUTER_PREV_EDGES, routes_internal_data.GetPrevEdges().GetData(),
+                        routes_internal_data.GetPrevEdges().GetSize());
+    }
 
-    proto_stop.set_id(stop.stop_id);
-    proto_stop.set_name(stop.stop_name);
-    proto_stop.mutable_coordinates()->set_latitude(stop.coordinates.lat);
-    proto_stop.mutable_coordinates()->set_longitude(stop.coordinates.lng);
-    return proto_stop;
+    writer.Write(output);
 }
 
-tc_serialize::Distances Serializer::SerializeDistance(const Stop& stop_from, 
-                                                      const Stop& stop_to, 
-                                                      double distance) const {
-    tc_serialize::Distances proto_distance;
-    proto_distance.set_stop_from_id(stop_from.stop_id);
-    proto_distance.set_stop_to_id(stop_to.stop_id);
-    proto_distance.set_distance(distance);
-    return proto_distance;
+//Stops go in the order of their vertices, stops that have none after them in the catalogue order
+tc_serialize::TransportCatalogue Serializer::SerializeCatalogue(TransportCatalogue& catalogue,
+                                                                const RouteBuilder& builder) const {
+    tc_serialize::TransportCatalogue proto_catalogue;
+    std::vector<const Stop*> stops;
+    std::vector<graph::VertexId> stop_vertices;
+    for (const auto& stop : catalogue.GetStops()) {
+        const auto vertices = builder.FindStopVertices(stop.stop_name);
+        stops.push_back(&stop);
+        stop_vertices.push_back(vertices ? vertices->first : std::numeric_limits<graph::VertexId>::max());
+    }
+    std::vector<size_t> order(stops.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&stop_vertices](size_t lhs, size_t rhs) {
+        return stop_vertices[lhs] < stop_vertices[rhs];
+    });
+
+    std::unordered_map<const Stop*, uint32_t> stop_indexes;
+    bool is_scalable = true;
+    for (const size_t index : order) {
+        const Stop* stop = stops[index];
+        stop_indexes.emplace(stop, static_cast<uint32_t>(stop_indexes.size()));
+        proto_catalogue.add_names(stop->stop_name);
+        for (const double value : {stop->coordinates.lat, stop->coordinates.lng}) {
+            is_scalable = is_scalable && std::abs(value) <= 360.0
+                          && static_cast<double>(std::llround(value * COORDINATE_SCALE)) / COORDINATE_SCALE == value;
+        }
+    }
+    proto_catalogue.set_stop_count(stops.size());
+    if (is_scalable) {
+        proto_catalogue.set_coordinate_scale(COORDINATE_SCALE);
+        int64_t latitude = 0, longitude = 0;
+        for (const size_t index : order) {
+            const int64_t stop_latitude = std::llround(stops[index]->coordinates.lat * COORDINATE_SCALE);
+            const int64_t stop_longitude = std::llround(stops[index]->coordinates.lng * COORDINATE_SCALE);
+            proto_catalogue.add_latitude_deltas(stop_latitude - latitude);
+            proto_catalogue.add_longitude_deltas(stop_longitude - longitude);
+            latitude = stop_latitude;
+            longitude = stop_longitude;
+        }
+    }
+    else {
+        for (const size_t index : order) {
+            proto_catalogue.add_latitudes(stops[index]->coordinates.lat);
+            proto_catalogue.add_longitudes(stops[index]->coordinates.lng);
+        }
+    }
+
+    std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> distances;
+    for (const auto& [stop_pair, distance] : catalogue.GetDistances()) {
+        distances.emplace_back(stop_indexes.at(stop_pair.first), stop_indexes.at(stop_pair.second),
+                               static_cast<uint32_t>(distance));
+    }
+    std::sort(distances.begin(), distances.end());
+    uint32_t stop_from = 0, stop_to = 0;
+    for (const auto& [distance_from, distance_to, distance] : distances) {
+        proto_catalogue.add_distance_from_deltas(distance_from - stop_from);
+        proto_catalogue.add_distance_to_deltas(static_cast<int32_t>(distance_to - stop_to));
+        proto_catalogue.add_distances(distance);
+        stop_from = distance_from;
+        stop_to = distance_to;
+    }
+
+    for (const auto& route : catalogue.GetRoutes()) {
+        proto_catalogue.add_names(route.route_name);
+        *proto_catalogue.add_routes() = SerializeBus(route, stop_indexes, *catalogue.GetBusInfo(route.route_name));
+    }
+    return proto_catalogue;
 }
 
-tc_serialize::Bus Serializer::SerializeBus(const Bus& route) const {
+tc_serialize::Bus Serializer::SerializeBus(const Bus& route,
+                                           const std::unordered_map<const Stop*, uint32_t>& stop_indexes,
+                                           const BusInfo& info) const {
     tc_serialize::Bus proto_bus;
-    proto_bus.set_name(route.route_name);
     proto_bus.set_is_roundtrip(route.route_type == RouteType::RING_ROUTE);
+    uint32_t previous_index = 0;
     for (const auto& stop : route.route_stops) {
-        proto_bus.add_stop_ids(stop->stop_id);
+        const uint32_t index = stop_indexes.at(stop);
+        proto_bus.add_stop_deltas(static_cast<int32_t>(index - previous_index));
+        previous_index = index;
     }
+    const auto& [stop_count, unique_stop_count, route_length, curvature] = info;
+    tc_serialize::BusStats& proto_stats = *proto_bus.mutable_stats();
+    proto_stats.set_stop_count(stop_count);
+    proto_stats.set_unique_stop_count(unique_stop_count);
+    proto_stats.set_route_length(route_length);
+    proto_stats.set_curvature(curvature);
     return proto_bus;
 }
 
@@ -111,11 +335,36 @@ svg_serialize::Color Serializer::SerializeColor(const svg::Color& color) const {
     return proto_color;
 }
 
+map_serialize::RenderedMap Serializer::SerializeMap(const std::string& map) const {
+    map_serialize::RenderedMap proto_map;
+    proto_map.set_is_deflated(settings_.is_map_compressed);
+    proto_map.set_svg(settings_.is_map_compressed ? Deflate(map) : map);
+    return proto_map;
+}
+
 router_serialize::TransportRouter Serializer::SerializeCatalogueRouter(const RouteBuilder& builder) const {
+    router_serialize::TransportRouter proto_router = SerializeRouterExtras(builder);
+    ThreadPool thread_pool;
+    *proto_router.mutable_graph() = SerializeGraph(builder.GetRouteGraph(), thread_pool);
+    if (builder.HasRouter()) {
+        *proto_router.mutable_router() = SerializeRouter(builder.GetRouter(), builder.GetRouteGraph(), thread_pool);
+    }
+    return proto_router;
+}
+
+//Everything but the graph and the routes matrix
+router_serialize::TransportRouter Serializer::SerializeRouterExtras(const RouteBuilder& builder) const {
     router_serialize::TransportRouter proto_router;
     *proto_router.mutable_settings() = SerializeRouterSettings(builder.GetRoutingSettings());
-    *proto_router.mutable_graph() = SerializeGraph(builder.GetRouteGraph());
-    *proto_router.mutable_router() = SerializeRouter(builder.GetRouter());
+    for (const auto vertex : builder.GetVertexOrder()) {
+        proto_router.add_vertex_order(vertex);
+    }
+    if (builder.HasContractionHierarchy()) {
+        *proto_router.mutable_contraction_hierarchy() = SerializeContractionHierarchy(builder.GetContractionHierarchy());
+    }
+    if (!builder.GetLandmarks().vertices.empty()) {
+        *proto_router.mutable_landmarks() = SerializeLandmarks(builder.GetLandmarks());
+    }
     return proto_router;
 }
 
@@ -123,127 +372,416 @@ router_serialize::RouteSettings Serializer::SerializeRouterSettings(const Routin
     router_serialize::RouteSettings proto_settings;
     proto_settings.set_bus_wait_time(settings.bus_wait_time_min);
     proto_settings.set_bus_velocity(settings.bus_velocity_kmph);
+    proto_settings.set_router_type(static_cast<router_serialize::RouterType>(settings.router_type));
+    proto_settings.set_graph_model(static_cast<router_serialize::GraphModel>(settings.graph_model));
+    proto_settings.set_route_cache_size(settings.route_cache_size);
+    proto_settings.set_lazy_router_memory_mb(settings.lazy_router_memory_mb);
+    proto_settings.set_astar_landmarks(settings.astar_landmarks);
+    proto_settings.set_vertex_order(static_cast<router_serialize::VertexOrder>(settings.vertex_order));
     return proto_settings;
 }
 
-graph_serialize::DirectedWeightedGraph Serializer::SerializeGraph(const RouteBuilder::RouteGraph& graph) const {
+graph_serialize::DirectedWeightedGraph Serializer::SerializeGraph(const RouteBuilder::RouteGraph& graph,
+                                                                  ThreadPool& thread_pool) const {
     graph_serialize::DirectedWeightedGraph proto_graph;
-    for (const auto& edge : graph.GetEdges()) {
-        *proto_graph.add_edges() = SerializeEdge(edge);
-    }
-    for (const auto& inc_list : graph.GetIncidenceLists()) {
-        graph_serialize::IncidenceList* proto_inc_list = proto_graph.add_incidence_list();
-        for (const auto edge_id : inc_list) {
-            proto_inc_list->add_edges_id(edge_id);
+    const auto& edges = graph.GetEdges();
+    const size_t block_count = (edges.GetSize() + EDGES_PER_BLOCK - 1) / EDGES_PER_BLOCK;
+    std::vector<std::string> blocks(block_count);
+    thread_pool.ParallelFor(block_count, [&](size_t block) {
+        graph_serialize::EdgeBlock proto_block;
+        const size_t end = std::min(edges.GetSize(), (block + 1) * EDGES_PER_BLOCK);
+        int64_t previous_to = 0;
+        for (graph::EdgeId edge_id = block * EDGES_PER_BLOCK; edge_id < end; ++edge_id) {
+            const auto& edge = edges[edge_id];
+            proto_block.add_to_deltas(static_cast<int64_t>(edge.to) - previous_to);
+            proto_block.add_spend_times(edge.weight.spend_time);
+            proto_block.add_span_counts(edge.weight.span_count);
+            proto_block.add_label_ids(edge.weight.label_id);
+            proto_block.add_kinds(static_cast<graph_serialize::EdgeKind>(edge.weight.kind));
+            previous_to = static_cast<int64_t>(edge.to);
         }
+        blocks[block] = SerializeBlock(proto_block);
+    });
+    proto_graph.set_edge_count(edges.GetSize());
+    proto_graph.set_edges_per_block(EDGES_PER_BLOCK);
+    proto_graph.set_is_deflated(settings_.is_block_compressed);
+    for (auto& block : blocks) {
+        proto_graph.add_edge_blocks(std::move(block));
+    }
+    const auto& offsets = graph.GetOffsets();
+    for (graph::VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+        proto_graph.add_out_degrees(offsets[vertex + 1] - offsets[vertex]);
     }
     return proto_graph;
 }
 
-graph_serialize::Edge Serializer::SerializeEdge(const RouteBuilder::RouteEdge& edge) const {
-    graph_serialize::Edge proto_edge;
-    proto_edge.set_vertex_id_from(edge.from);
-    proto_edge.set_vertex_id_to(edge.to);
-    *proto_edge.mutable_weight() = SerializeWeight(edge.weight);
-    return proto_edge;
-}
-
-graph_serialize::EdgeWeight Serializer::SerializeWeight(const EdgeWeight& weight) const {
-    graph_serialize::EdgeWeight proto_weight;
-    proto_weight.set_spend_time(weight.spend_time);
-    proto_weight.set_span_count(weight.span_count);
-    proto_weight.set_edge_type(weight.edge_type);
-    return proto_weight;
-}
-
-graph_serialize::Router Serializer::SerializeRouter(const RouteBuilder::TcRouter& router) const {
+//Rows are stored as packed arrays; with compress_blocks every cell is coded against what the graph and
+//the routes to the other vertices predict, see RouterBlock
+graph_serialize::Router Serializer::SerializeRouter(const RouteBuilder::TcRouter& router,
+                                                    const RouteBuilder::RouteGraph& graph,
+                                                    ThreadPool& thread_pool) const {
+    using TcRouter = RouteBuilder::TcRouter;
     graph_serialize::Router proto_router;
-    for (const auto& router_data : router.GetRoutesInternalData()) {
-        graph_serialize::RoutesInternalData proto_routes_data;
-        for (const auto& int_data : router_data) {
-            graph_serialize::OptRouteInternalData proto_route_data;
-            if (int_data.has_value()) {
-                proto_route_data.mutable_data()->mutable_edge_weight()->set_spend_time(int_data.value().weight.spend_time);
-                if (int_data.value().prev_edge.has_value()) {
-                    proto_route_data.mutable_data()->mutable_prev_edge()->set_edge_id(int_data.value().prev_edge.value());
+    const auto& routes_internal_data = router.GetRoutesInternalData();
+    const size_t vertex_count = routes_internal_data.GetVertexCount();
+    if (vertex_count != graph.GetVertexCount()) {
+        throw std::logic_error("Routes matrix doesn't match the graph");
+    }
+    const std::vector<uint32_t> incoming_positions = GetIncomingPositions(graph);
+    const size_t rows_per_block = std::max<size_t>(1, ROUTER_BLOCK_CELLS / std::max<size_t>(1, vertex_count));
+    const size_t block_count = (vertex_count + rows_per_block - 1) / rows_per_block;
+    std::vector<std::string> blocks(block_count);
+    const auto& weights = routes_internal_data.GetWeights();
+    const auto& prev_edges = routes_internal_data.GetPrevEdges();
+    thread_pool.ParallelFor(block_count, [&](size_t block) {
+        graph_serialize::RouterBlock proto_block;
+        const size_t end = std::min(vertex_count, (block + 1) * rows_per_block);
+        if (!settings_.is_block_compressed) {
+            proto_block.mutable_weights()->Add(weights.begin() + block * rows_per_block * vertex_count,
+                                               weights.begin() + end * vertex_count);
+            proto_block.mutable_prev_edges()->Add(prev_edges.begin() + block * rows_per_block * vertex_count,
+                                                  prev_edges.begin() + end * vertex_count);
+            blocks[block] = SerializeBlock(proto_block);
+            return;
+        }
+        for (graph::VertexId from = block * rows_per_block; from < end; ++from) {
+            for (graph::VertexId to = 0; to < vertex_count; ++to) {
+                const auto prev_edge = routes_internal_data.GetPrevEdge(from, to);
+                double prediction = from == to ? 0.0 : TcRouter::INFINITE_WEIGHT;
+                if (prev_edge) {
+                    const auto& edge = graph.GetEdge(*prev_edge);
+                    prediction = routes_internal_data.GetWeight(from, edge.from) + edge.weight.spend_time;
                 }
+                proto_block.add_prev_edge_positions(prev_edge ? incoming_positions[*prev_edge] + 1 : 0);
+                proto_block.add_weight_corrections(GetBitDifference(routes_internal_data.GetWeight(from, to), prediction));
             }
-            *proto_routes_data.add_routes_int_data() = proto_route_data;
         }
-        *proto_router.add_router_data() = proto_routes_data;
+        blocks[block] = SerializeBlock(proto_block);
+    });
+    proto_router.set_vertex_count(vertex_count);
+    proto_router.set_rows_per_block(rows_per_block);
+    proto_router.set_is_deflated(settings_.is_block_compressed);
+    proto_router.set_is_predicted(settings_.is_block_compressed);
+    for (auto& block : blocks) {
+        proto_router.add_row_blocks(std::move(block));
     }
     return proto_router;
 }
 
+std::string Serializer::SerializeBlock(const google::protobuf::MessageLite& proto_block) const {
+    if (!settings_.is_block_compressed) {
+        return proto_block.SerializeAsString();
+    }
+    std::string block;
+    google::protobuf::io::StringOutputStream string_stream(&block);
+    google::protobuf::io::GzipOutputStream::Options options;
+    options.format = google::protobuf::io::GzipOutputStream::ZLIB;
+    google::protobuf::io::GzipOutputStream deflate_stream(&string_stream, options);
+    if (!proto_block.SerializeToZeroCopyStream(&deflate_stream) || !deflate_stream.Close()) {
+        throw std::runtime_error("Can't compress a database block");
+    }
+    return block;
+}
+
+graph_serialize::ContractionHierarchy Serializer::SerializeContractionHierarchy(const RouteBuilder::TcContractionHierarchy& hierarchy) const {
+    graph_serialize::ContractionHierarchy proto_hierarchy;
+    for (const uint32_t rank : hierarchy.GetRanks()) {
+        proto_hierarchy.add_ranks(rank);
+    }
+    for (const auto& edge : hierarchy.GetEdges()) {
+        graph_serialize::HierarchyEdge* proto_edge = proto_hierarchy.add_edges();
+        proto_edge->set_vertex_id_from(edge.from);
+        proto_edge->set_vertex_id_to(edge.to);
+        proto_edge->set_weight(edge.weight);
+        if (edge.IsShortcut()) {
+            proto_edge->set_first_half(edge.first_half);
+            proto_edge->set_second_half(edge.second_half);
+        }
+        else {
+            proto_edge->mutable_original_edge()->set_edge_id(edge.original_edge);
+        }
+    }
+    return proto_hierarchy;
+}
+
+graph_serialize::Landmarks Serializer::SerializeLandmarks(const RouteBuilder::TcAStarRouter::Landmarks& landmarks) const {
+    graph_serialize::Landmarks proto_landmarks;
+    for (const auto vertex : landmarks.vertices) {
+        proto_landmarks.add_vertices(vertex);
+    }
+    proto_landmarks.mutable_weights_from()->Add(landmarks.weights_from.begin(), landmarks.weights_from.end());
+    proto_landmarks.mutable_weights_to()->Add(landmarks.weights_to.begin(), landmarks.weights_to.end());
+    return proto_landmarks;
+}
+
 //-------------------------Deserialize-------------------------
 
-RenderSettings Serializer::GetFromFile(TransportCatalogue& catalogue, RouteBuilder& builder) {
-    std::ifstream in_file(settings_.path_to_db, std::ios::binary);
-    proto_data_.ParseFromIstream(&in_file);
-    DeserializeCatalogue(catalogue);
-    RenderSettings render_settings = DeserializeRenderSettings();
-    DeserializeCatalogueRouter(builder);
+//Skipped sections are passed over with a seek, their bytes aren't read
+RenderSettings Serializer::GetFromFile(TransportCatalogue& catalogue, RouteBuilder& builder, bool is_router_needed,
+                                      std::optional<std::string>* map) {
+    if (flat_db::IsFlatDatabase(settings_.path_to_db)) {
+        return GetFromFlatFile(catalogue, builder, is_router_needed, map);
+    }
+    using google::protobuf::internal::WireFormatLite;
+    const int descriptor = OpenForReading(settings_.path_to_db);
+    if (descriptor < 0) {
+        throw std::runtime_error("Can't open " + settings_.path_to_db.string());
+    }
+    google::protobuf::io::FileInputStream raw_input(descriptor);
+    raw_input.SetCloseOnDelete(true);
+    google::protobuf::io::CodedInputStream input(&raw_input);
+    input.SetTotalBytesLimit(std::numeric_limits<int>::max());
+    uint32_t version = 0;
+    if (input.ReadTag() != WireFormatLite::MakeTag(tc_serialize::CatalogueData::kVersionFieldNumber,
+                                                   WireFormatLite::WIRETYPE_VARINT)
+        || !input.ReadVarint32(&version) || version != DATABASE_VERSION) {
+        throw std::runtime_error("Unknown database format");
+    }
+    std::optional<RenderSettings> render_settings;
+    bool has_route_builder = false;
+    for (uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+        if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                throw std::runtime_error("Damaged database");
+            }
+            continue;
+        }
+        const int field_number = WireFormatLite::GetTagFieldNumber(tag);
+        if ((field_number == tc_serialize::CatalogueData::kRouteBuilderFieldNumber && !is_router_needed)
+            || (field_number == tc_serialize::CatalogueData::kMapFieldNumber && !map)) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                throw std::runtime_error("Damaged database");
+            }
+            continue;
+        }
+        google::protobuf::Arena arena;
+        switch (field_number) {
+        case tc_serialize::CatalogueData::kCatalogueFieldNumber:
+            DeserializeCatalogue(ParseSection<tc_serialize::TransportCatalogue>(input, arena), catalogue);
+            break;
+        case tc_serialize::CatalogueData::kRenderSettingsFieldNumber:
+            render_settings = DeserializeRenderSettings(ParseSection<map_serialize::RenderSettings>(input, arena));
+            break;
+        case tc_serialize::CatalogueData::kRouteBuilderFieldNumber:
+            DeserializeCatalogueRouter(ParseSection<router_serialize::TransportRouter>(input, arena), builder);
+            has_route_builder = true;
+            break;
+        case tc_serialize::CatalogueData::kMapFieldNumber:
+            *map = DeserializeMap(ParseSection<map_serialize::RenderedMap>(input, arena));
+            break;
+        default:
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                throw std::runtime_error("Damaged database");
+            }
+        }
+    }
+    if (!input.ConsumedEntireMessage()) {
+        throw std::runtime_error("Damaged database");
+    }
+    //Sections left out of the file hold default values, as with a whole message parse
+    if (!has_route_builder && is_router_needed) {
+        DeserializeCatalogueRouter(router_serialize::TransportRouter::default_instance(), builder);
+    }
+    return render_settings ? std::move(*render_settings)
+                           : DeserializeRenderSettings(map_serialize::RenderSettings::default_instance());
+}
+
+//The graph and the routes matrix stay in the mapped file, the builder keeps the mapping alive
+RenderSettings Serializer::GetFromFlatFile(TransportCatalogue& catalogue, RouteBuilder& builder, bool is_router_needed,
+                                          std::optional<std::string>* map) {
+    const flat_db::Reader reader(std::make_shared<const MappedFile>(settings_.path_to_db), sizeof(RouteBuilder::RouteEdge));
+    google::protobuf::Arena arena;
+    const auto parse_section = [&reader, &arena](auto* message, flat_db::SectionKind kind) {
+        const std::string_view data = reader.GetSection(kind);
+        if (!message->ParseFromArray(data.data(), static_cast<int>(data.size()))) {
+            throw std::runtime_error("Damaged settings section in the database");
+        }
+        return message;
+    };
+    DeserializeFlatCatalogue(reader, catalogue);
+    RenderSettings render_settings = DeserializeRenderSettings(*parse_section(
+        google::protobuf::Arena::CreateMessage<map_serialize::RenderSettings>(&arena), flat_db::SectionKind::RENDER_SETTINGS));
+    if (map && reader.HasSection(flat_db::SectionKind::MAP)) {
+        *map = std::string(reader.GetSection(flat_db::SectionKind::MAP));
+    }
+    else if (map && reader.HasSection(flat_db::SectionKind::DEFLATED_MAP)) {
+        *map = Inflate(reader.GetSection(flat_db::SectionKind::DEFLATED_MAP));
+    }
+    if (!is_router_needed) {
+        return render_settings;
+    }
+    const auto& proto_route_builder = *parse_section(
+        google::protobuf::Arena::CreateMessage<router_serialize::TransportRouter>(&arena), flat_db::SectionKind::ROUTE_BUILDER);
+    builder.SetStorageOwner(reader.GetFile());
+    builder.SetRoutingSettings(DeserializeRoutingSettings(proto_route_builder.settings()));
+    builder.SetGraph(DeserializeFlatGraph(reader));
+    std::unique_ptr<RouteBuilder::TcRouter> router_ptr;
+    if (reader.HasSection(flat_db::SectionKind::ROUTER_WEIGHTS)) {
+        router_ptr = DeserializeFlatRouter(reader, builder.GetRouteGraph().GetVertexCount());
+    }
+    DeserializeRouteEngine(proto_route_builder, std::move(router_ptr), builder);
     return render_settings;
 }
 
-void Serializer::DeserializeCatalogue(TransportCatalogue& catalogue) {
-    tc_serialize::TransportCatalogue* proto_catalogue = proto_data_.mutable_catalogue();
-    for (const auto& stop : proto_catalogue->stops()) {
-        catalogue.AddStop(DeserializeStop(stop));
+void Serializer::DeserializeFlatCatalogue(const flat_db::Reader& reader, TransportCatalogue& catalogue) const {
+    const auto [stops, stops_count] = reader.GetArray<flat_db::StopRecord>(flat_db::SectionKind::STOPS);
+    std::vector<Stop*> stop_ptrs;
+    stop_ptrs.reserve(stops_count);
+    for (size_t index = 0; index < stops_count; ++index) {
+        const std::string_view name = reader.GetName(stops[index].name);
+        catalogue.AddStop(Stop(std::string(name), stops[index].latitude, stops[index].longitude));
+        stop_ptrs.push_back(catalogue.FindStop(name));
+    }
+    const auto [distances, distances_count] = reader.GetArray<flat_db::DistanceRecord>(flat_db::SectionKind::DISTANCES);
+    for (size_t index = 0; index < distances_count; ++index) {
+        catalogue.SetDistance(stop_ptrs.at(distances[index].stop_from), stop_ptrs.at(distances[index].stop_to),
+                              distances[index].distance);
     }
-    for (const auto& distance : proto_catalogue->distances()) {
-        DeserializeDistance(distance, catalogue);
+    const auto [buses, buses_count] = reader.GetArray<flat_db::BusRecord>(flat_db::SectionKind::BUSES);
+    const auto [bus_stops, bus_stops_count] = reader.GetArray<uint32_t>(flat_db::SectionKind::BUS_STOPS);
+    for (size_t index = 0; index < buses_count; ++index) {
+        const auto& record = buses[index];
+        if (record.first_stop > bus_stops_count || record.stop_count > bus_stops_count - record.first_stop) {
+            throw std::runtime_error("Damaged bus in the database");
+        }
+        std::vector<Stop*> route_stops;
+        route_stops.reserve(record.stop_count);
+        for (size_t position = record.first_stop; position < record.first_stop + record.stop_count; ++position) {
+            route_stops.push_back(stop_ptrs.at(bus_stops[position]));
+        }
+        catalogue.AddBus(Bus(std::string(reader.GetName(record.name)),
+                             record.is_roundtrip ? RouteType::RING_ROUTE : RouteType::LINER_ROUTE,
+                             std::move(route_stops)));
+    }
+    if (!reader.HasSection(flat_db::SectionKind::BUS_STATS)) {
+        return;
     }
-    for (const auto& route : proto_catalogue->routes()) {
-        catalogue.AddBus(DeserializeBus(route, catalogue));
+    const auto [bus_stats, bus_stats_count] = reader.GetArray<flat_db::BusStatsRecord>(flat_db::SectionKind::BUS_STATS);
+    if (bus_stats_count != buses_count) {
+        throw std::runtime_error("Damaged bus statistics in the database");
+    }
+    for (size_t index = 0; index < buses_count; ++index) {
+        const auto& record = bus_stats[index];
+        catalogue.SetBusInfo(reader.GetName(buses[index].name),
+                             BusInfo{record.stop_count, record.unique_stop_count, record.route_length, record.curvature});
     }
 }
 
-Stop Serializer::DeserializeStop(const tc_serialize::Stop& proto_stop) const {
-    Stop source_stop;
-    source_stop.stop_name = proto_stop.name();
-    source_stop.coordinates.lat = proto_stop.coordinates().latitude();
-    source_stop.coordinates.lng = proto_stop.coordinates().longitude();
-    return source_stop;
+RouteBuilder::RouteGraph Serializer::DeserializeFlatGraph(const flat_db::Reader& reader) const {
+    const auto [edges, edges_count] = reader.GetArray<RouteBuilder::RouteEdge>(flat_db::SectionKind::GRAPH_EDGES);
+    const auto [offsets, offsets_count] = reader.GetArray<graph::EdgeId>(flat_db::SectionKind::GRAPH_OFFSETS);
+    const auto [incoming_offsets, incoming_offsets_count] =
+        reader.GetArray<graph::EdgeId>(flat_db::SectionKind::GRAPH_INCOMING_OFFSETS);
+    const auto [incoming_edges, incoming_edges_count] =
+        reader.GetArray<graph::EdgeId>(flat_db::SectionKind::GRAPH_INCOMING_EDGES);
+    RouteBuilder::RouteGraph result;
+    result.SetEdges(ArrayStorage<RouteBuilder::RouteEdge>::Borrow(edges, edges_count),
+                    ArrayStorage<graph::EdgeId>::Borrow(offsets, offsets_count),
+                    ArrayStorage<graph::EdgeId>::Borrow(incoming_offsets, incoming_offsets_count),
+                    ArrayStorage<graph::EdgeId>::Borrow(incoming_edges, incoming_edges_count));
+    return result;
 }
 
-void Serializer::DeserializeDistance(const tc_serialize::Distances& proto_distance, 
-                                     TransportCatalogue& catalogue) const {
-    Stop* stop_from = catalogue.FindStop(proto_distance.stop_from_id());
-    Stop* stop_to = catalogue.FindStop(proto_distance.stop_to_id());
-    double distance = proto_distance.distance();
-    catalogue.SetDistance(stop_from, stop_to, distance);
+std::unique_ptr<RouteBuilder::TcRouter> Serializer::DeserializeFlatRouter(const flat_db::Reader& reader,
+                                                                          size_t vertex_count) const {
+    using PackedEdgeId = RouteBuilder::TcRouter::PackedEdgeId;
+    const auto [weights, weights_count] = reader.GetArray<double>(flat_db::SectionKind::ROUTER_WEIGHTS);
+    const auto [prev_edges, prev_edges_count] = reader.GetArray<PackedEdgeId>(flat_db::SectionKind::ROUTER_PREV_EDGES);
+    if (weights_count != vertex_count * vertex_count || prev_edges_count != weights_count) {
+        throw std::runtime_error("Routes matrix doesn't match the graph");
+    }
+    auto router_ptr = std::make_unique<RouteBuilder::TcRouter>();
+    router_ptr->GetRoutesInternalData() = RouteBuilder::TcRouter::RoutesInternalData::Borrow(vertex_count, weights, prev_edges);
+    return router_ptr;
 }
 
-Bus Serializer::DeserializeBus(const tc_serialize::Bus& proto_route,
-                               const TransportCatalogue& catalogue) const {
+void Serializer::DeserializeCatalogue(const tc_serialize::TransportCatalogue& proto_catalogue,
+                                      TransportCatalogue& catalogue) const {
+    const size_t stop_count = proto_catalogue.stop_count();
+    const size_t coordinate_count = proto_catalogue.coordinate_scale() ? proto_catalogue.latitude_deltas_size()
+                                                                       : proto_catalogue.latitudes_size();
+    const size_t longitude_count = proto_catalogue.coordinate_scale() ? proto_catalogue.longitude_deltas_size()
+                                                                      : proto_catalogue.longitudes_size();
+    if (static_cast<size_t>(proto_catalogue.names_size()) != stop_count + proto_catalogue.routes_size()
+        || coordinate_count != stop_count || longitude_count != stop_count
+        || proto_catalogue.distance_to_deltas_size() != proto_catalogue.distance_from_deltas_size()
+        || proto_catalogue.distances_size() != proto_catalogue.distance_from_deltas_size()) {
+        throw std::runtime_error("Damaged catalogue in the database");
+    }
+    std::vector<Stop*> stops;
+    stops.reserve(stop_count);
+    int64_t latitude = 0, longitude = 0;
+    for (size_t index = 0; index < stop_count; ++index) {
+        Stop stop;
+        stop.stop_name = proto_catalogue.names(index);
+        if (const double scale = static_cast<double>(proto_catalogue.coordinate_scale()); scale > 0) {
+            latitude += proto_catalogue.latitude_deltas(index);
+            longitude += proto_catalogue.longitude_deltas(index);
+            stop.coordinates.lat = static_cast<double>(latitude) / scale;
+            stop.coordinates.lng = static_cast<double>(longitude) / scale;
+        }
+        else {
+            stop.coordinates.lat = proto_catalogue.latitudes(index);
+            stop.coordinates.lng = proto_catalogue.longitudes(index);
+        }
+        catalogue.AddStop(stop);
+        stops.push_back(catalogue.FindStop(stop.stop_name));
+    }
+    uint32_t stop_from = 0, stop_to = 0;
+    for (int index = 0; index < proto_catalogue.distances_size(); ++index) {
+        stop_from += proto_catalogue.distance_from_deltas(index);
+        stop_to += static_cast<uint32_t>(proto_catalogue.distance_to_deltas(index));
+        if (stop_from >= stop_count || stop_to >= stop_count) {
+            throw std::runtime_error("Damaged catalogue in the database");
+        }
+        catalogue.SetDistance(stops[stop_from], stops[stop_to], proto_catalogue.distances(index));
+    }
+    for (int index = 0; index < proto_catalogue.routes_size(); ++index) {
+        const tc_serialize::Bus& proto_route = proto_catalogue.routes(index);
+        catalogue.AddBus(DeserializeBus(proto_route, proto_catalogue.names(stop_count + index), stops));
+        //Databases written before the statistics were stored leave them to be computed on request
+        if (proto_route.has_stats()) {
+            const tc_serialize::BusStats& proto_stats = proto_route.stats();
+            catalogue.SetBusInfo(proto_catalogue.names(stop_count + index),
+                                 BusInfo{ proto_stats.stop_count(), proto_stats.unique_stop_count(),
+                                          proto_stats.route_length(), proto_stats.curvature() });
+        }
+    }
+}
+
+Bus Serializer::DeserializeBus(const tc_serialize::Bus& proto_route, std::string name,
+                               const std::vector<Stop*>& stops) const {
     Bus source_route;
-    source_route.route_name = proto_route.name();
+    source_route.route_name = std::move(name);
     source_route.route_type = proto_route.is_roundtrip() ? RouteType::RING_ROUTE
                                                          : RouteType::LINER_ROUTE;
-    for (const auto& stop_id : proto_route.stop_ids()) {
-        source_route.route_stops.push_back(catalogue.FindStop(stop_id));
+    uint32_t index = 0;
+    for (const int32_t delta : proto_route.stop_deltas()) {
+        index += static_cast<uint32_t>(delta);
+        if (index >= stops.size()) {
+            throw std::runtime_error("Damaged catalogue in the database");
+        }
+        source_route.route_stops.push_back(stops[index]);
     }
     return source_route;
 }
 
-RenderSettings Serializer::DeserializeRenderSettings() {
+RenderSettings Serializer::DeserializeRenderSettings(const map_serialize::RenderSettings& proto_settings) const {
     RenderSettings result;
-    map_serialize::RenderSettings* proto_settings = proto_data_.mutable_render_settings();
-    result.width = proto_settings->width();
-    result.height = proto_settings->height();
-    result.padding = proto_settings->padding();
-    result.line_width = proto_settings->line_width();
-    result.stop_radius = proto_settings->stop_radius();
-    result.bus_label_font_size = proto_settings->bus_label_font_size();
-    result.bus_label_offset = { proto_settings->mutable_bus_label_offset()->x(),
-                                proto_settings->mutable_bus_label_offset()->y() };
-    result.stop_label_font_size = proto_settings->stop_label_font_size();
-    result.stop_label_offset = { proto_settings->mutable_stop_label_offset()->x(),
-                                 proto_settings->mutable_stop_label_offset()->y() };
-    result.underlayer_width = proto_settings->underlayer_width();
-    result.underlayer_color = DeserializeColor(proto_settings->underlayer_color());
-    for (const auto& color : proto_settings->color_palette()) {
+    result.width = proto_settings.width();
+    result.height = proto_settings.height();
+    result.padding = proto_settings.padding();
+    result.line_width = proto_settings.line_width();
+    result.stop_radius = proto_settings.stop_radius();
+    result.bus_label_font_size = proto_settings.bus_label_font_size();
+    result.bus_label_offset = { proto_settings.bus_label_offset().x(),
+                                proto_settings.bus_label_offset().y() };
+    result.stop_label_font_size = proto_settings.stop_label_font_size();
+    result.stop_label_offset = { proto_settings.stop_label_offset().x(),
+                                 proto_settings.stop_label_offset().y() };
+    result.underlayer_width = proto_settings.underlayer_width();
+    result.underlayer_color = DeserializeColor(proto_settings.underlayer_color());
+    for (const auto& color : proto_settings.color_palette()) {
         result.color_palette.push_back(DeserializeColor(color));
     }
     return result;
@@ -273,83 +811,238 @@ svg::Color Serializer::DeserializeColor(const svg_serialize::Color& proto_color)
     return color;
 }
 
-void Serializer::DeserializeCatalogueRouter(RouteBuilder& builder) {
-    router_serialize::TransportRouter* proto_route_builder = proto_data_.mutable_route_builder();
-    builder.SetRoutingSettings(DeserializeRoutingSettings(proto_route_builder->settings()));
-    builder.SetGraph(DeserializeGraph(proto_route_builder->graph()));
-    auto builder_ptr = std::move(DeserializeRouter(proto_route_builder->router()));
-    builder_ptr->SetGraph(builder.GetRouteGraph());
-    builder.SetRouter(std::move(builder_ptr));
+std::string Serializer::DeserializeMap(const map_serialize::RenderedMap& proto_map) const {
+    return proto_map.is_deflated() ? Inflate(proto_map.svg()) : proto_map.svg();
+}
+
+void Serializer::DeserializeCatalogueRouter(const router_serialize::TransportRouter& proto_route_builder,
+                                            RouteBuilder& builder) const {
+    builder.SetRoutingSettings(DeserializeRoutingSettings(proto_route_builder.settings()));
+    ThreadPool thread_pool;
+    builder.SetGraph(DeserializeGraph(proto_route_builder.graph(), thread_pool));
+    std::unique_ptr<RouteBuilder::TcRouter> router_ptr;
+    if (proto_route_builder.has_router()) {
+        router_ptr = DeserializeRouter(proto_route_builder.router(), builder.GetRouteGraph(), thread_pool);
+    }
+    DeserializeRouteEngine(proto_route_builder, std::move(router_ptr), builder);
+}
+
+//Restores whatever the route engine kept at make_base, a missing routes matrix is built anew
+void Serializer::DeserializeRouteEngine(const router_serialize::TransportRouter& proto_route_builder,
+                                        std::unique_ptr<RouteBuilder::TcRouter> router_ptr,
+                                        RouteBuilder& builder) const {
+    builder.SetVertexOrder({proto_route_builder.vertex_order().begin(), proto_route_builder.vertex_order().end()});
+    if (proto_route_builder.has_contraction_hierarchy()) {
+        auto hierarchy_ptr = DeserializeContractionHierarchy(proto_route_builder.contraction_hierarchy());
+        hierarchy_ptr->SetGraph(builder.GetRouteGraph());
+        builder.SetContractionHierarchy(std::move(hierarchy_ptr));
+        return;
+    }
+    if (proto_route_builder.has_landmarks()) {
+        builder.SetLandmarks(DeserializeLandmarks(proto_route_builder.landmarks()));
+        return;
+    }
+    if (!router_ptr) {
+        builder.BuildRouter();
+        return;
+    }
+    router_ptr->SetGraph(builder.GetRouteGraph());
+    builder.SetRouter(std::move(router_ptr));
 }
 
 RoutingSettings Serializer::DeserializeRoutingSettings(const router_serialize::RouteSettings& proto_settings) const {
     RoutingSettings result;
     result.bus_wait_time_min = proto_settings.bus_wait_time();
     result.bus_velocity_kmph = proto_settings.bus_velocity();
+    result.router_type = static_cast<RouterType>(proto_settings.router_type());
+    result.graph_model = static_cast<GraphModel>(proto_settings.graph_model());
+    result.route_cache_size = proto_settings.route_cache_size();
+    result.lazy_router_memory_mb = proto_settings.lazy_router_memory_mb();
+    result.astar_landmarks = proto_settings.astar_landmarks();
+    result.vertex_order = static_cast<VertexOrder>(proto_settings.vertex_order());
     return result;
 }
 
-RouteBuilder::RouteGraph Serializer::DeserializeGraph(const graph_serialize::DirectedWeightedGraph& proto_graph) const {
+//Every block is decoded on its own into its place in the preallocated edges
+RouteBuilder::RouteGraph Serializer::DeserializeGraph(const graph_serialize::DirectedWeightedGraph& proto_graph,
+                                                      ThreadPool& thread_pool) const {
     RouteBuilder::RouteGraph result;
-    std::vector<RouteBuilder::RouteEdge> graph_edges;
-    std::vector<RouteBuilder::RouteGraph::IncidenceList> graph_incidence_list;
-    for (const auto& proto_edge : proto_graph.edges()) {
-        RouteBuilder::RouteEdge edge = std::move(DeserializeEdge(proto_edge));
-        graph_edges.push_back(std::move(edge));
-    }
-    for (const auto& proto_incidence_list : proto_graph.incidence_list()) {
-        std::vector<graph::EdgeId> id_list;
-        for (const auto& proto_edge_id : proto_incidence_list.edges_id()) {
-            id_list.push_back(proto_edge_id);
-        }
-        graph_incidence_list.push_back(std::move(id_list));
+    const size_t edge_count = proto_graph.edge_count();
+    const size_t edges_per_block = proto_graph.edges_per_block();
+    if (edge_count > 0 && (edges_per_block == 0
+        || static_cast<size_t>(proto_graph.edge_blocks_size()) != (edge_count + edges_per_block - 1) / edges_per_block)) {
+        throw std::runtime_error("Damaged graph in the database");
+    }
+    std::vector<graph::EdgeId> graph_offsets = {0};
+    for (const uint32_t out_degree : proto_graph.out_degrees()) {
+        graph_offsets.push_back(graph_offsets.back() + out_degree);
     }
-    result.SetEdges(graph_edges);
-    result.SetIncidenceList(graph_incidence_list);
+    if (graph_offsets.back() != edge_count) {
+        throw std::runtime_error("Damaged graph in the database");
+    }
+    std::vector<RouteBuilder::RouteEdge> graph_edges(edge_count);
+    thread_pool.ParallelFor(proto_graph.edge_blocks_size(), [&](size_t block) {
+        graph_serialize::EdgeBlock proto_block;
+        const size_t begin = block * edges_per_block;
+        const size_t count = std::min(edges_per_block, edge_count - begin);
+        DeserializeBlock(proto_graph.edge_blocks(block), proto_graph.is_deflated(), proto_block);
+        if (static_cast<size_t>(proto_block.to_deltas_size()) != count
+            || static_cast<size_t>(proto_block.spend_times_size()) != count
+            || static_cast<size_t>(proto_block.span_counts_size()) != count
+            || static_cast<size_t>(proto_block.label_ids_size()) != count
+            || static_cast<size_t>(proto_block.kinds_size()) != count) {
+            throw std::runtime_error("Damaged graph in the database");
+        }
+        //The source of the block's first edge is found by a search over the offsets, the next ones by a walk
+        graph::VertexId from = std::upper_bound(graph_offsets.begin(), graph_offsets.end(), begin) - graph_offsets.begin() - 1;
+        int64_t to = 0;
+        for (size_t index = 0; index < count; ++index) {
+            while (graph_offsets[from + 1] <= begin + index) {
+                ++from;
+            }
+            to += proto_block.to_deltas(index);
+            if (to < 0 || static_cast<size_t>(to) >= static_cast<size_t>(proto_graph.out_degrees_size())) {
+                throw std::runtime_error("Damaged graph in the database");
+            }
+            auto& edge = graph_edges[begin + index];
+            edge.from = from;
+            edge.to = static_cast<graph::VertexId>(to);
+            edge.weight.spend_time = proto_block.spend_times(index);
+            edge.weight.span_count = static_cast<int>(proto_block.span_counts(index));
+            edge.weight.label_id = proto_block.label_ids(index);
+            edge.weight.kind = static_cast<EdgeKind>(proto_block.kinds(index));
+        }
+    });
+    result.SetEdges(std::move(graph_edges), std::move(graph_offsets));
     return result;
 }
 
-RouteBuilder::RouteEdge Serializer::DeserializeEdge(const graph_serialize::Edge& proto_edge) const {
-    RouteBuilder::RouteEdge result;
-    result.from = proto_edge.vertex_id_from();
-    result.to = proto_edge.vertex_id_to();
-    result.weight = std::move(DeserializeWeight(proto_edge.weight()));
-    return result;
+//Row blocks are decoded in parallel straight into the preallocated matrix, packed rows are plain copies.
+//A predicted weight needs the weight of the route to the last edge's source, so the routes of such a row
+//are restored along their tree paths
+std::unique_ptr<RouteBuilder::TcRouter> Serializer::DeserializeRouter(const graph_serialize::Router& proto_router,
+                                                                      const RouteBuilder::RouteGraph& graph,
+                                                                      ThreadPool& thread_pool) const {
+    using TcRouter = RouteBuilder::TcRouter;
+    using PackedEdgeId = TcRouter::PackedEdgeId;
+    const size_t vertex_count = proto_router.vertex_count();
+    const size_t rows_per_block = proto_router.rows_per_block();
+    if (vertex_count != graph.GetVertexCount() || (vertex_count > 0 && (rows_per_block == 0
+        || static_cast<size_t>(proto_router.row_blocks_size()) != (vertex_count + rows_per_block - 1) / rows_per_block))) {
+        throw std::runtime_error("Damaged routes matrix in the database");
+    }
+    std::vector<double> weights(vertex_count * vertex_count);
+    std::vector<PackedEdgeId> prev_edges(vertex_count * vertex_count);
+    thread_pool.ParallelFor(proto_router.row_blocks_size(), [&](size_t block) {
+        graph_serialize::RouterBlock proto_block;
+        const size_t begin = block * rows_per_block;
+        const size_t row_count = std::min(rows_per_block, vertex_count - begin);
+        DeserializeBlock(proto_router.row_blocks(block), proto_router.is_deflated(), proto_block);
+        if (!proto_router.is_predicted()) {
+            if (static_cast<size_t>(proto_block.weights_size()) != row_count * vertex_count
+                || static_cast<size_t>(proto_block.prev_edges_size()) != row_count * vertex_count) {
+                throw std::runtime_error("Damaged routes matrix in the database");
+            }
+            std::copy(proto_block.weights().begin(), proto_block.weights().end(), weights.begin() + begin * vertex_count);
+            std::copy(proto_block.prev_edges().begin(), proto_block.prev_edges().end(),
+                      prev_edges.begin() + begin * vertex_count);
+            return;
+        }
+        if (static_cast<size_t>(proto_block.prev_edge_positions_size()) != row_count * vertex_count
+            || static_cast<size_t>(proto_block.weight_corrections_size()) != row_count * vertex_count) {
+            throw std::runtime_error("Damaged routes matrix in the database");
+        }
+        std::vector<bool> is_restored(vertex_count);
+        std::vector<graph::VertexId> path;
+        for (size_t row = 0; row < row_count; ++row) {
+            const graph::VertexId from = begin + row;
+            const size_t row_begin = from * vertex_count;
+            const size_t block_row_begin = row * vertex_count;
+            for (graph::VertexId to = 0; to < vertex_count; ++to) {
+                const uint32_t position = proto_block.prev_edge_positions(block_row_begin + to);
+                const auto incoming_edges = graph.GetIncomingEdges(to);
+                if (position > static_cast<size_t>(incoming_edges.end() - incoming_edges.begin())) {
+                    throw std::runtime_error("Damaged routes matrix in the database");
+                }
+                prev_edges[row_begin + to] = position == 0 ? TcRouter::NO_EDGE
+                                                           : static_cast<PackedEdgeId>(incoming_edges.begin()[position - 1]);
+            }
+            std::fill(is_restored.begin(), is_restored.end(), false);
+            for (graph::VertexId to = 0; to < vertex_count; ++to) {
+                for (graph::VertexId vertex = to; !is_restored[vertex];) {
+                    path.push_back(vertex);
+                    const PackedEdgeId prev_edge = prev_edges[row_begin + vertex];
+                    if (prev_edge == TcRouter::NO_EDGE || path.size() > vertex_count) {
+                        break;
+                    }
+                    vertex = graph.GetEdge(prev_edge).from;
+                }
+                if (path.size() > vertex_count) {
+                    throw std::runtime_error("Damaged routes matrix in the database");
+                }
+                for (auto it = path.rbegin(); it != path.rend(); ++it) {
+                    const graph::VertexId vertex = *it;
+                    const PackedEdgeId prev_edge = prev_edges[row_begin + vertex];
+                    double prediction = vertex == from ? 0.0 : TcRouter::INFINITE_WEIGHT;
+                    if (prev_edge != TcRouter::NO_EDGE) {
+                        const auto& edge = graph.GetEdge(prev_edge);
+                        prediction = weights[row_begin + edge.from] + edge.weight.spend_time;
+                    }
+                    weights[row_begin + vertex] = ApplyBitDifference(prediction, proto_block.weight_corrections(block_row_begin + vertex));
+                    is_restored[vertex] = true;
+                }
+                path.clear();
+            }
+        }
+    });
+    auto router_ptr = std::make_unique<RouteBuilder::TcRouter>();
+    router_ptr->GetRoutesInternalData() = RouteBuilder::TcRouter::RoutesInternalData(
+        vertex_count, std::move(weights), std::move(prev_edges));
+    return router_ptr;
 }
 
-EdgeWeight Serializer::DeserializeWeight(const graph_serialize::EdgeWeight& proto_weight) const {
-    EdgeWeight result;
-    result.spend_time = proto_weight.spend_time();
-    result.span_count = proto_weight.span_count();
-    result.edge_type = proto_weight.edge_type();
-    return result;
+void Serializer::DeserializeBlock(const std::string& block, bool is_deflated,
+                                  google::protobuf::MessageLite& proto_block) const {
+    bool is_parsed = false;
+    if (is_deflated) {
+        google::protobuf::io::ArrayInputStream array_stream(block.data(), static_cast<int>(block.size()));
+        google::protobuf::io::GzipInputStream inflate_stream(&array_stream, google::protobuf::io::GzipInputStream::ZLIB);
+        is_parsed = proto_block.ParseFromZeroCopyStream(&inflate_stream);
+    }
+    else {
+        is_parsed = proto_block.ParseFromString(block);
+    }
+    if (!is_parsed) {
+        throw std::runtime_error("Damaged block in the database");
+    }
 }
 
-std::unique_ptr<RouteBuilder::TcRouter> Serializer::DeserializeRouter(const graph_serialize::Router& proto_router) const {
-    auto router_ptr = std::make_unique<RouteBuilder::TcRouter>();
-    auto& routes_internal_data = router_ptr->GetRoutesInternalData();
-    size_t data_size = proto_router.router_data_size();
-    routes_internal_data.resize(data_size);
-    for (int i = 0; i < data_size; ++i) {
-        size_t internal_size = proto_router.router_data(i).routes_int_data_size();
-        routes_internal_data[i].resize(internal_size);
-        for (int j = 0; j < internal_size; ++j) {
-            if (proto_router.router_data(i).routes_int_data(j).has_data()) {
-                RouteBuilder::TcRouter::RouteInternalData int_data;
-                auto& proto_data = proto_router.router_data(i).routes_int_data(j).data();
-                int_data.weight.spend_time = proto_data.edge_weight().spend_time();
-                if (proto_data.has_prev_edge()) {
-                    int_data.prev_edge = proto_data.prev_edge().edge_id();
-                }
-                else {
-                    int_data.prev_edge = {};
-                }
-                routes_internal_data[i][j] = std::move(int_data);
-            }
-            else {
-                routes_internal_data[i][j] = {};
-            }
+std::unique_ptr<RouteBuilder::TcContractionHierarchy> Serializer::DeserializeContractionHierarchy(
+    const graph_serialize::ContractionHierarchy& proto_hierarchy) const {
+    using HierarchyEdge = RouteBuilder::TcContractionHierarchy::HierarchyEdge;
+    std::vector<uint32_t> ranks(proto_hierarchy.ranks().begin(), proto_hierarchy.ranks().end());
+    std::vector<HierarchyEdge> edges;
+    edges.reserve(proto_hierarchy.edges_size());
+    for (const auto& proto_edge : proto_hierarchy.edges()) {
+        HierarchyEdge edge{proto_edge.vertex_id_from(), proto_edge.vertex_id_to(), proto_edge.weight()};
+        if (proto_edge.has_original_edge()) {
+            edge.original_edge = proto_edge.original_edge().edge_id();
+        }
+        else {
+            edge.first_half = proto_edge.first_half();
+            edge.second_half = proto_edge.second_half();
         }
+        edges.push_back(edge);
     }
-    return router_ptr;
+    auto hierarchy_ptr = std::make_unique<RouteBuilder::TcContractionHierarchy>();
+    hierarchy_ptr->SetHierarchy(std::move(ranks), std::move(edges));
+    return hierarchy_ptr;
+}
+
+RouteBuilder::TcAStarRouter::Landmarks Serializer::DeserializeLandmarks(const graph_serialize::Landmarks& proto_landmarks) const {
+    RouteBuilder::TcAStarRouter::Landmarks landmarks;
+    landmarks.vertices.assign(proto_landmarks.vertices().begin(), proto_landmarks.vertices().end());
+    landmarks.weights_from.assign(proto_landmarks.weights_from().begin(), proto_landmarks.weights_from().end());
+    landmarks.weights_to.assign(proto_landmarks.weights_to().begin(), proto_landmarks.weights_to().end());
+    return landmarks;
 }
\ No newline at end of file
@@ -2,20 +2,39 @@
 
 #include <filesystem>
 #include <fstream>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/gzip_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "flat_database.h"
 #include "svg.pb.h"
 #include "graph.pb.h"
 #include "transport_catalogue.h"
 #include "transport_catalogue.pb.h"
 #include "map_renderer.h"
 #include "map_renderer.pb.h"
+#include "thread_pool.h"
 #include "transport_router.h"
 #include "transport_router.pb.h"
 
+enum class DatabaseFormat {
+	PROTOBUF,
+	FLAT, // fixed-layout sections, process_requests maps the file and uses the graph and the routes matrix in place
+};
+
 struct SerializeSettings {
 	std::filesystem::path path_to_db;
+	std::optional<DatabaseFormat> format; // unset: protobuf for make_base, the format of the patched file for patch_base
+	bool is_block_compressed = false; // protobuf format: edge and routes matrix blocks are deflated
+	bool is_map_compressed = false; // the stored map is deflated
 };
 
 class Serializer {
@@ -26,43 +45,77 @@ public:
 
 	void SetSettings(const SerializeSettings& settings);
 
-	void SaveToFile(TransportCatalogue& catalogue, const RenderSettings& settings, const RouteBuilder& builder);
+	// The file is written under a temporary name and renamed over the old one, so it's never seen half-written
+	// and a process that has the old database mapped keeps reading it
+	// The map is the SVG document drawn for the catalogue, Map requests answer with it as it is
+	void SaveToFile(TransportCatalogue& catalogue, const RenderSettings& settings, const RouteBuilder& builder,
+	                const std::string& map);
 
-	RenderSettings GetFromFile(TransportCatalogue& catalogue, RouteBuilder& builder);
+	// The format is taken from the file itself. A protobuf database is read one top-level section at a time,
+	// each parsed on its own arena that is dropped as soon as the section is converted.
+	// Without is_router_needed the route builder sections are skipped unread and the builder is left empty.
+	// The stored map is read only into a given map, which stays empty if the database has none
+	RenderSettings GetFromFile(TransportCatalogue& catalogue, RouteBuilder& builder, bool is_router_needed = true,
+	                           std::optional<std::string>* map = nullptr);
 
 private:
 
+	// Sizes of the blocks the graph edges and the routes matrix are split into, each block is coded on its own thread
+	static constexpr size_t EDGES_PER_BLOCK = 1 << 14;
+	static constexpr size_t ROUTER_BLOCK_CELLS = 1 << 17;
+	// Coordinates are kept in 1e-7 degree, about a centimetre
+	static constexpr int64_t COORDINATE_SCALE = 10'000'000;
+	// Version of the protobuf layout, databases of any other layout are rejected
+	static constexpr uint32_t DATABASE_VERSION = 1;
+
 	SerializeSettings settings_;
-	tc_serialize::CatalogueData proto_data_;
 
-	tc_serialize::TransportCatalogue SerializeCatalogue(TransportCatalogue& catalogue) const;
-	tc_serialize::Stop SerializeStop(const Stop& stop) const;
-	tc_serialize::Distances SerializeDistance(const Stop& stop_from, const Stop& stop_to, double distance) const;
-	tc_serialize::Bus SerializeBus(const Bus& route) const;
+	void SaveToFlatFile(TransportCatalogue& catalogue, const RenderSettings& settings, const RouteBuilder& builder,
+	                    const std::string& map, std::ostream& output);
+
+	tc_serialize::TransportCatalogue SerializeCatalogue(TransportCatalogue& catalogue, const RouteBuilder& builder) const;
+	tc_serialize::Bus SerializeBus(const Bus& route, const std::unordered_map<const Stop*, uint32_t>& stop_indexes,
+	                               const BusInfo& info) const;
 
 	map_serialize::RenderSettings SerializeRenderSettings(const RenderSettings& settings) const;
 	svg_serialize::Color SerializeColor(const svg::Color& color) const;
+	map_serialize::RenderedMap SerializeMap(const std::string& map) const;
 
 	router_serialize::TransportRouter SerializeCatalogueRouter(const RouteBuilder& builder) const;
+	router_serialize::TransportRouter SerializeRouterExtras(const RouteBuilder& builder) const;
 	router_serialize::RouteSettings SerializeRouterSettings(const RoutingSettings& settings) const;
-	graph_serialize::DirectedWeightedGraph SerializeGraph(const RouteBuilder::RouteGraph& graph) const;
-	graph_serialize::Edge SerializeEdge(const RouteBuilder::RouteEdge& edge) const;
-	graph_serialize::EdgeWeight SerializeWeight(const EdgeWeight& weight) const;
-	graph_serialize::Router SerializeRouter(const RouteBuilder::TcRouter& router) const;
-
-	void DeserializeCatalogue(TransportCatalogue& catalogue);
-	Stop DeserializeStop(const tc_serialize::Stop& proto_stop) const;
-	Bus DeserializeBus(const tc_serialize::Bus& proto_route, const TransportCatalogue&) const;
-	void DeserializeDistance(const tc_serialize::Distances& proto_distance, TransportCatalogue&) const;
+	graph_serialize::DirectedWeightedGraph SerializeGraph(const RouteBuilder::RouteGraph& graph, ThreadPool& thread_pool) const;
+	graph_serialize::Router SerializeRouter(const RouteBuilder::TcRouter& router, const RouteBuilder::RouteGraph& graph,
+	                                       ThreadPool& thread_pool) const;
+	std::string SerializeBlock(const google::protobuf::MessageLite& proto_block) const;
+	graph_serialize::ContractionHierarchy SerializeContractionHierarchy(const RouteBuilder::TcContractionHierarchy& hierarchy) const;
+	graph_serialize::Landmarks SerializeLandmarks(const RouteBuilder::TcAStarRouter::Landmarks& landmarks) const;
+
+	RenderSettings GetFromFlatFile(TransportCatalogue& catalogue, RouteBuilder& builder, bool is_router_needed,
+	                               std::optional<std::string>* map);
+	void DeserializeFlatCatalogue(const flat_db::Reader& reader, TransportCatalogue& catalogue) const;
+	RouteBuilder::RouteGraph DeserializeFlatGraph(const flat_db::Reader& reader) const;
+	std::unique_ptr<RouteBuilder::TcRouter> DeserializeFlatRouter(const flat_db::Reader& reader, size_t vertex_count) const;
+
+	void DeserializeCatalogue(const tc_serialize::TransportCatalogue& proto_catalogue, TransportCatalogue& catalogue) const;
+	Bus DeserializeBus(const tc_serialize::Bus& proto_route, std::string name, const std::vector<Stop*>& stops) const;
 	
-	RenderSettings DeserializeRenderSettings();
+	RenderSettings DeserializeRenderSettings(const map_serialize::RenderSettings& proto_settings) const;
 	svg::Color DeserializeColor(const svg_serialize::Color& proto_color) const;
+	std::string DeserializeMap(const map_serialize::RenderedMap& proto_map) const;
 
-	void DeserializeCatalogueRouter(RouteBuilder& builder);
+	void DeserializeCatalogueRouter(const router_serialize::TransportRouter& proto_route_builder, RouteBuilder& builder) const;
+	void DeserializeRouteEngine(const router_serialize::TransportRouter& proto_route_builder,
+		                        std::unique_ptr<RouteBuilder::TcRouter> router_ptr, RouteBuilder& builder) const;
 	RoutingSettings DeserializeRoutingSettings(const router_serialize::RouteSettings& proto_settings) const;
-	RouteBuilder::RouteGraph DeserializeGraph(const graph_serialize::DirectedWeightedGraph& proto_graph) const;
-	RouteBuilder::RouteEdge DeserializeEdge(const graph_serialize::Edge& proto_edge) const;
-	EdgeWeight DeserializeWeight(const graph_serialize::EdgeWeight& proto_weight) const;
-	std::unique_ptr<RouteBuilder::TcRouter> DeserializeRouter(const graph_serialize::Router& proto_router) const;
+	RouteBuilder::RouteGraph DeserializeGraph(const graph_serialize::DirectedWeightedGraph& proto_graph,
+	                                          ThreadPool& thread_pool) const;
+	std::unique_ptr<RouteBuilder::TcRouter> DeserializeRouter(const graph_serialize::Router& proto_router,
+	                                                          const RouteBuilder::RouteGraph& graph,
+	                                                          ThreadPool& thread_pool) const;
+	void DeserializeBlock(const std::string& block, bool is_deflated, google::protobuf::MessageLite& proto_block) const;
+	std::unique_ptr<RouteBuilder::TcContractionHierarchy> DeserializeContractionHierarchy(
+		const graph_serialize::ContractionHierarchy& proto_hierarchy) const;
+	RouteBuilder::TcAStarRouter::Landmarks DeserializeLandmarks(const graph_serialize::Landmarks& proto_landmarks) const;
 
 };
\ No newline at end of file
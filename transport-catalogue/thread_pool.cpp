@@ -0,0 +1,86 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+ThreadPool::ThreadPool()
+	: ThreadPool(std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+//The calling thread of ParallelFor is one of thread_count, so only thread_count - 1 workers are started
+ThreadPool::ThreadPool(size_t thread_count) {
+	for (size_t index = 1; index < thread_count; ++index) {
+		workers_.emplace_back([this] { Work(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+	task_ready_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::GetThreadCount() const {
+	return workers_.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t task_count, const std::function<void(size_t)>& task) {
+	if (workers_.empty() || task_count < 2) {
+		for (size_t index = 0; index < task_count; ++index) {
+			task(index);
+		}
+		return;
+	}
+	std::unique_lock lock(mutex_);
+	task_ = &task;
+	task_count_ = task_count;
+	next_task_ = 0;
+	finished_tasks_ = 0;
+	error_ = nullptr;
+	task_ready_.notify_all();
+	RunTasks(lock);
+	batch_done_.wait(lock, [this] { return finished_tasks_ == task_count_; });
+	task_ = nullptr;
+	if (error_) {
+		std::rethrow_exception(std::exchange(error_, nullptr));
+	}
+}
+
+void ThreadPool::Work() {
+	std::unique_lock lock(mutex_);
+	while (true) {
+		task_ready_.wait(lock, [this] { return stopping_ || (task_ && next_task_ < task_count_); });
+		if (stopping_) {
+			return;
+		}
+		RunTasks(lock);
+	}
+}
+
+//Takes tasks of the current batch one by one until none is left, the lock is released while a task runs
+void ThreadPool::RunTasks(std::unique_lock<std::mutex>& lock) {
+	const auto* task = task_;
+	while (next_task_ < task_count_) {
+		const size_t index = next_task_++;
+		lock.unlock();
+		std::exception_ptr error = nullptr;
+		try {
+			(*task)(index);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+		if (error && !error_) {
+			error_ = error;
+		}
+		if (++finished_tasks_ == task_count_) {
+			batch_done_.notify_all();
+		}
+	}
+}
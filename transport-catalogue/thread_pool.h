@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run batches of indexed tasks
+class ThreadPool {
+public:
+
+	ThreadPool();
+	explicit ThreadPool(size_t thread_count);
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool();
+
+	size_t GetThreadCount() const;
+
+	// Runs task(index) for every index in [0, task_count) and returns when all of them are done.
+	// The calling thread takes part in the work; the first exception thrown by a task is rethrown
+	void ParallelFor(size_t task_count, const std::function<void(size_t)>& task);
+
+private:
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable task_ready_;
+	std::condition_variable batch_done_;
+
+	const std::function<void(size_t)>* task_ = nullptr;
+	size_t task_count_ = 0;
+	size_t next_task_ = 0;
+	size_t finished_tasks_ = 0;
+	std::exception_ptr error_ = nullptr;
+	bool stopping_ = false;
+
+	void Work();
+	void RunTasks(std::unique_lock<std::mutex>& lock);
+
+};
@@ -1,5 +1,7 @@
 #include "transport_catalogue.h"
 
+#include "thread_pool.h"
+
 using namespace geo;
 
 size_t PairHasher::operator()(std::pair<Stop*, Stop*> obj) const {
@@ -55,25 +57,53 @@ void TransportCatalogue::SetDistance(Stop* from_stop, Stop* to_stop, double dist
 
 //Return output information about particular route (total route stops, unique stops, real distance (m) and curvature)
 std::optional<BusInfo> TransportCatalogue::GetBusInfo(std::string_view route_name) const {
+	if (const auto it = bus_info_index_.find(route_name); it != bus_info_index_.end()) {
+		return it->second;
+	}
 	if (bus_routes_index_.count(route_name) == 0) return {};
-	BusInfo result;
+	const auto [route_stops, route_type] = FindBus(route_name);
+	return CalculateBusInfo(*route_stops, route_type);
+}
+
+void TransportCatalogue::ComputeBusInfo() {
+	std::vector<BusInfo> bus_info(bus_routes_.size());
+	ThreadPool thread_pool;
+	thread_pool.ParallelFor(bus_routes_.size(), [&](size_t index) {
+		bus_info[index] = CalculateBusInfo(bus_routes_[index].route_stops, bus_routes_[index].route_type);
+	});
+	for (size_t index = 0; index < bus_routes_.size(); ++index) {
+		bus_info_index_[bus_routes_[index].route_name] = bus_info[index];
+	}
+}
+
+void TransportCatalogue::SetBusInfo(std::string_view route_name, const BusInfo& info) {
+	const auto it = bus_routes_index_.find(route_name);
+	if (it == bus_routes_index_.end()) {
+		throw std::out_of_range("Unknown bus");
+	}
+	bus_info_index_[it->first] = info;
+}
+
+//Walks the route once over the stop pointers it keeps, a linear route is counted there and back
+BusInfo TransportCatalogue::CalculateBusInfo(const std::vector<Stop*>& route_stops, RouteType route_type) const {
+	if (route_stops.empty()) {
+		return { 0, 0, 0.0, 0.0 };
+	}
 	double coordinate_distance = 0, real_distance = 0;
-	std::unordered_set<std::string> unique_stops;
-	auto [route_stops, route_type] = FindBus(route_name);
-	size_t end_index = route_stops->size();
-	unique_stops.insert(route_stops->at(0)->stop_name);
-	for (size_t index = 0; index < end_index - 1; ++index) {
-		auto from_stop = FindStop(route_stops->at(index)->stop_name);
-		auto to_stop = FindStop(route_stops->at(index + 1)->stop_name);
+	std::unordered_set<const Stop*> unique_stops;
+	unique_stops.insert(route_stops.front());
+	for (size_t index = 0; index + 1 < route_stops.size(); ++index) {
+		Stop* from_stop = route_stops[index];
+		Stop* to_stop = route_stops[index + 1];
 		coordinate_distance += ComputeDistance(from_stop->coordinates, to_stop->coordinates);
 		real_distance += ComputeRealDistance(from_stop, to_stop, route_type);
-		unique_stops.insert(to_stop->stop_name);
+		unique_stops.insert(to_stop);
 	}
-	result = route_type == RouteType::LINER_ROUTE ? std::tuple{ end_index * 2 - 1, unique_stops.size(),
+	const size_t end_index = route_stops.size();
+	return route_type == RouteType::LINER_ROUTE ? BusInfo{ end_index * 2 - 1, unique_stops.size(),
 		real_distance, real_distance * 1.0 / (coordinate_distance * 2) }
-	: std::tuple{ end_index, unique_stops.size(),
-				  real_distance, real_distance * 1.0 / coordinate_distance };
-	return result;
+	: BusInfo{ end_index, unique_stops.size(),
+			   real_distance, real_distance * 1.0 / coordinate_distance };
 }
 
 const std::deque<Stop>& TransportCatalogue::GetStops() const {
@@ -160,17 +190,14 @@ RouteInfo TransportCatalogue::FindBus(std::string_view route_name) const {
 }
 
 //Calculate distance between stop1 and stop2 (in both directions for linear route)
+//A distance given one way only holds both ways
 double TransportCatalogue::ComputeRealDistance(Stop* stop1, Stop* stop2, RouteType type) const {
-	double result = 0;
-	if (type == RouteType::LINER_ROUTE) {
-		stops_distance_index_.count({ stop1, stop2 }) ? result += stops_distance_index_.at({ stop1, stop2 })
-			: result += stops_distance_index_.at({ stop2, stop1 });
-		stops_distance_index_.count({ stop2, stop1 }) ? result += stops_distance_index_.at({ stop2, stop1 })
-			: result *= 2;
-	}
-	else {
-		stops_distance_index_.count({ stop1, stop2 }) ? result += stops_distance_index_.at({ stop1, stop2 })
-			: result += stops_distance_index_.at({ stop2, stop1 });
+	const auto forward = stops_distance_index_.find({ stop1, stop2 });
+	const double forward_distance = forward != stops_distance_index_.end() ? forward->second
+		                                                                   : stops_distance_index_.at({ stop2, stop1 });
+	if (type != RouteType::LINER_ROUTE) {
+		return forward_distance;
 	}
-	return result;
+	const auto backward = stops_distance_index_.find({ stop2, stop1 });
+	return forward_distance + (backward != stops_distance_index_.end() ? backward->second : forward_distance);
 }
\ No newline at end of file
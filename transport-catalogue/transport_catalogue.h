@@ -40,6 +40,11 @@ public:
 	void SetDistance(std::string_view from_stop, std::string_view to_stop, double distnace);
 	void SetDistance(Stop* from_stop, Stop* to_stop, double distance);
 
+	// Computes the statistics of every bus in parallel, Bus requests only look them up afterwards.
+	// Buses added later are computed on request
+	void ComputeBusInfo();
+	void SetBusInfo(std::string_view route_name, const BusInfo& info);
+
 	std::optional<BusInfo> GetBusInfo(std::string_view route_name) const;
 	std::optional<std::set<std::string>> GetStopInfo(std::string_view stop_name) const;
 
@@ -71,7 +76,9 @@ private:
 	std::unordered_map<std::string_view, RouteInfo> bus_routes_index_;
 	std::unordered_map<std::string_view, std::set<std::string>> route_to_stops_index_;
 	std::unordered_map<std::pair<Stop*, Stop*>, double, PairHasher> stops_distance_index_;
+	std::unordered_map<std::string_view, BusInfo> bus_info_index_;
 
+	BusInfo CalculateBusInfo(const std::vector<Stop*>& route_stops, RouteType route_type) const;
 	double ComputeRealDistance(Stop* stop1, Stop* stop2, RouteType type) const;
 
 };
\ No newline at end of file
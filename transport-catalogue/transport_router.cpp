@@ -1,7 +1,37 @@
 #include "transport_router.h"
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
 using namespace graph;
 
+namespace {
+
+const int HILBERT_ORDER = 16;
+
+//Position of a cell of the 2^HILBERT_ORDER x 2^HILBERT_ORDER grid along the Hilbert curve
+uint64_t GetHilbertIndex(uint32_t x, uint32_t y) {
+	const uint32_t side = 1u << HILBERT_ORDER;
+	uint64_t index = 0;
+	for (uint32_t half = side / 2; half > 0; half /= 2) {
+		const uint32_t rx = (x & half) > 0 ? 1 : 0;
+		const uint32_t ry = (y & half) > 0 ? 1 : 0;
+		index += static_cast<uint64_t>(half) * half * ((3 * rx) ^ ry);
+		//The quadrant is turned so that the curve inside it starts in its corner
+		if (ry == 0) {
+			if (rx == 1) {
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+}  // namespace
+
 //-------------------------EdgeWeight-------------------------
 
 EdgeWeight EdgeWeight::operator+(const EdgeWeight& other) const {
@@ -28,15 +58,34 @@ bool EdgeWeight::operator>(const EdgeWeight& other) const {
 //-------------------------RouteBuilder-------------------------
 
 RouteBuilder::RouteBuilder(size_t stops_count, RoutingSettings settings)
-	: route_graph_(stops_count * 2)
+	: route_graph_(settings.graph_model == GraphModel::ROUTE_PATTERNS ? stops_count : stops_count * 2)
 	, routing_settings_(std::move(settings))
-{}
+{
+	ResetRouteCache();
+}
 
 const RouteBuilder::RouteGraph& RouteBuilder::BuildGraph(const TransportCatalogue& catalogue,
 	                                                     const std::set<std::string_view>& route_names,
 	                                                     const std::set<std::string_view>& stop_names) {
-	BuildSubgraphForStops(stop_names);
-	BuildSubgraphForRoutes(catalogue, route_names);
+	SetEdgeLabels(stop_names, route_names);
+	if (routing_settings_.router_type == RouterType::RAPTOR) {
+		BuildRaptorRouter(catalogue, route_names, stop_names);
+		return route_graph_;
+	}
+	switch (routing_settings_.graph_model) {
+	case GraphModel::STOP_PAIRS:
+		BuildSubgraphForStops(stop_names);
+		BuildSubgraphForRoutes(catalogue, route_names);
+		break;
+	case GraphModel::ROUTE_PATTERNS:
+		SetStopToVertexId(stop_names);
+		BuildRoutePatterns(catalogue, route_names);
+		break;
+	}
+	if (routing_settings_.vertex_order == VertexOrder::HILBERT) {
+		RenumberVertices(catalogue);
+	}
+	route_graph_.Finalize();
 	return route_graph_;
 }
 
@@ -48,27 +97,266 @@ RoutingSettings RouteBuilder::GetRoutingSettings() const {
 	return routing_settings_;
 }
 
+//Wait edges are labeled with a stop name, bus edges with a bus name
+std::string_view RouteBuilder::GetEdgeLabel(const EdgeWeight& weight) const {
+	return weight.kind == EdgeKind::WAIT ? stop_labels_.at(weight.label_id) : bus_labels_.at(weight.label_id);
+}
+
 const RouteBuilder::TcRouter& RouteBuilder::GetRouter() const {
 	return *router_ptr_;
 }
 
-void RouteBuilder::SetGraph(const RouteGraph& graph) {
-	route_graph_ = graph;
+bool RouteBuilder::HasRouter() const {
+	return router_ptr_ != nullptr;
+}
+
+const RouteBuilder::TcContractionHierarchy& RouteBuilder::GetContractionHierarchy() const {
+	return *contraction_hierarchy_ptr_;
+}
+
+bool RouteBuilder::HasContractionHierarchy() const {
+	return contraction_hierarchy_ptr_ != nullptr;
+}
+
+const RouteBuilder::TcAStarRouter::Landmarks& RouteBuilder::GetLandmarks() const {
+	return landmarks_;
+}
+
+const std::vector<VertexId>& RouteBuilder::GetVertexOrder() const {
+	return vertex_order_;
+}
+
+//Stops without buses and every stop of the RAPTOR router have no vertices
+std::optional<RouteBuilder::VertexPair> RouteBuilder::FindStopVertices(std::string_view stop_name) const {
+	const auto it = vertex_to_stop_.find(stop_name);
+	if (it == vertex_to_stop_.end()) {
+		return std::nullopt;
+	}
+	return it->second;
+}
+
+size_t RouteBuilder::GetSettledVertexCount() const {
+	return astar_router_ptr_ ? astar_router_ptr_->GetSettledVertexCount() : 0;
+}
+
+void RouteBuilder::SetGraph(RouteGraph graph) {
+	route_graph_ = std::move(graph);
 }
 
 void RouteBuilder::SetRoutingSettings(const RoutingSettings& settings) {
 	routing_settings_ = settings;
+	ResetRouteCache();
+}
+
+RouteBuilder::RouteCache::Stats RouteBuilder::GetRouteCacheStats() const {
+	return route_cache_ptr_ ? route_cache_ptr_->GetStats() : RouteCache::Stats{};
+}
+
+void RouteBuilder::ResetRouteCache() {
+	route_cache_ptr_ = routing_settings_.route_cache_size > 0
+		? std::make_unique<RouteCache>(routing_settings_.route_cache_size)
+		: nullptr;
 }
 
 void RouteBuilder::SetRouter(std::unique_ptr<RouteBuilder::TcRouter>&& router) {
 	router_ptr_ = std::move(router);
 }
 
+void RouteBuilder::SetContractionHierarchy(std::unique_ptr<RouteBuilder::TcContractionHierarchy>&& hierarchy) {
+	contraction_hierarchy_ptr_ = std::move(hierarchy);
+}
+
+void RouteBuilder::SetLandmarks(TcAStarRouter::Landmarks landmarks) {
+	landmarks_ = std::move(landmarks);
+}
+
+void RouteBuilder::SetVertexOrder(std::vector<VertexId> vertex_order) {
+	vertex_order_ = std::move(vertex_order);
+}
+
+void RouteBuilder::SetStorageOwner(std::shared_ptr<const void> owner) {
+	storage_owner_ = std::move(owner);
+}
+
+//In the route patterns model a stop has a single vertex, used both for waiting and for alighting
 void RouteBuilder::SetStopToVertexId(const std::set<std::string_view> stop_names) {
 	VertexId id = 0;
 	for (const auto stop : stop_names) {
-		vertex_to_stop_[stop] = { id, (id + 1) };
-		id += 2;
+		if (routing_settings_.graph_model == GraphModel::ROUTE_PATTERNS) {
+			vertex_to_stop_[stop] = { id, id };
+			id += 1;
+		}
+		else {
+			vertex_to_stop_[stop] = { id, (id + 1) };
+			id += 2;
+		}
+	}
+	ApplyVertexOrder();
+}
+
+//Moves the stops' vertices to the ids of the renumbered graph
+void RouteBuilder::ApplyVertexOrder() {
+	if (vertex_order_.empty()) {
+		return;
+	}
+	for (auto& [_, vertices] : vertex_to_stop_) {
+		vertices = { vertex_order_.at(vertices.first), vertex_order_.at(vertices.second) };
+	}
+}
+
+//Stop labels are sorted, a stop label is also the stop index of the RAPTOR router
+std::optional<uint32_t> RouteBuilder::FindStopLabel(std::string_view stop_name) const {
+	const auto it = std::lower_bound(stop_labels_.begin(), stop_labels_.end(), stop_name);
+	if (it == stop_labels_.end() || *it != stop_name) {
+		return std::nullopt;
+	}
+	return static_cast<uint32_t>(it - stop_labels_.begin());
+}
+
+void RouteBuilder::SetEdgeLabels(const std::set<std::string_view>& stop_names,
+	                             const std::set<std::string_view>& route_names) {
+	stop_labels_.assign(stop_names.begin(), stop_names.end());
+	bus_labels_.assign(route_names.begin(), route_names.end());
+}
+
+//Prepares the route search engine chosen in routing settings
+void RouteBuilder::BuildRouter() {
+	switch (routing_settings_.router_type) {
+	case RouterType::ALL_PAIRS:
+		router_ptr_ = std::make_unique<TcRouter>(route_graph_);
+		break;
+	case RouterType::DIJKSTRA:
+		dijkstra_router_ptr_ = std::make_unique<TcDijkstraRouter>(route_graph_);
+		break;
+	case RouterType::CONTRACTION_HIERARCHIES:
+		contraction_hierarchy_ptr_ = std::make_unique<TcContractionHierarchy>(route_graph_);
+		break;
+	case RouterType::RAPTOR:
+		//Needs the catalogue, built by BuildRaptorRouter
+		break;
+	case RouterType::LAZY:
+		lazy_router_ptr_ = std::make_unique<TcLazyRouter>(route_graph_, routing_settings_.lazy_router_memory_mb << 20);
+		break;
+	case RouterType::ASTAR:
+		//Only the landmarks go to the database, the router needs the stop coordinates and is built by BuildAStarRouter
+		landmarks_ = TcAStarRouter::SelectLandmarks(route_graph_, routing_settings_.astar_landmarks);
+		break;
+	}
+}
+
+//Router of a patched catalogue that reuses the routes matrix of the previous builder. Vertices and edges of both
+//graphs are matched by their stops and labels, so this needs the all pairs router over the stop pairs model.
+//Other engines have nothing to reuse and are prepared anew
+void RouteBuilder::RepairRouter(const RouteBuilder& previous) {
+	if (routing_settings_.router_type != RouterType::ALL_PAIRS || routing_settings_.graph_model != GraphModel::STOP_PAIRS
+		|| previous.routing_settings_.graph_model != GraphModel::STOP_PAIRS || !previous.HasRouter()) {
+		BuildRouter();
+		return;
+	}
+	const RouteGraph& previous_graph = previous.GetRouteGraph();
+	std::vector<std::optional<VertexId>> vertex_map(previous_graph.GetVertexCount());
+	for (const auto& [stop, vertices] : previous.vertex_to_stop_) {
+		if (const auto it = vertex_to_stop_.find(stop); it != vertex_to_stop_.end()) {
+			vertex_map.at(vertices.first) = it->second.first;
+			vertex_map.at(vertices.second) = it->second.second;
+		}
+	}
+	//An edge is kept if it links the same vertices with the same weight, changed edges count as removed and added
+	using EdgeKey = std::tuple<VertexId, VertexId, EdgeKind, std::string_view, int, double>;
+	std::map<EdgeKey, std::vector<EdgeId>> edges_by_key;
+	for (EdgeId edge_id = 0; edge_id < route_graph_.GetEdgeCount(); ++edge_id) {
+		const RouteEdge& edge = route_graph_.GetEdge(edge_id);
+		edges_by_key[{ edge.from, edge.to, edge.weight.kind, GetEdgeLabel(edge.weight),
+			edge.weight.span_count, edge.weight.spend_time }].push_back(edge_id);
+	}
+	std::vector<std::optional<EdgeId>> edge_map(previous_graph.GetEdgeCount());
+	for (EdgeId edge_id = 0; edge_id < previous_graph.GetEdgeCount(); ++edge_id) {
+		const RouteEdge& edge = previous_graph.GetEdge(edge_id);
+		if (!vertex_map[edge.from] || !vertex_map[edge.to]) {
+			continue;
+		}
+		const auto it = edges_by_key.find({ *vertex_map[edge.from], *vertex_map[edge.to], edge.weight.kind,
+			previous.GetEdgeLabel(edge.weight), edge.weight.span_count, edge.weight.spend_time });
+		if (it != edges_by_key.end() && !it->second.empty()) {
+			edge_map[edge_id] = it->second.back();
+			it->second.pop_back();
+		}
+	}
+	ThreadPool thread_pool;
+	router_ptr_ = std::make_unique<TcRouter>(route_graph_, previous_graph, previous.GetRouter().GetRoutesInternalData(),
+		                                     vertex_map, edge_map, thread_pool);
+}
+
+void RouteBuilder::BuildRaptorRouter(const TransportCatalogue& catalogue,
+	                                 const std::set<std::string_view>& route_names,
+	                                 const std::set<std::string_view>& stop_names) {
+	raptor_router_ptr_ = std::make_unique<RaptorRouter>(catalogue, route_names, stop_names,
+		                                                static_cast<double>(routing_settings_.bus_wait_time_min),
+		                                                routing_settings_.bus_velocity_kmph);
+}
+
+//The geographic bound of a vertex pair is the ride time over the scaled great-circle distance between their stops
+void RouteBuilder::BuildAStarRouter(const TransportCatalogue& catalogue) {
+	std::vector<std::optional<geo::Coordinates>> vertex_coordinates;
+	for (const auto stop : GetVertexStops()) {
+		vertex_coordinates.push_back(stop.empty() ? std::nullopt
+			                                      : std::optional(catalogue.FindStop(stop)->coordinates));
+	}
+	const double ratio = GetRoadToGeoRatio(catalogue);
+	const double bus_velocity_kmph = routing_settings_.bus_velocity_kmph;
+	auto lower_bound = [vertex_coordinates = std::move(vertex_coordinates), ratio, bus_velocity_kmph](VertexId from, VertexId to) {
+		if (!vertex_coordinates[from] || !vertex_coordinates[to]) {
+			return 0.0;
+		}
+		return CalculateTime(ratio * geo::ComputeDistance(*vertex_coordinates[from], *vertex_coordinates[to]), bus_velocity_kmph);
+	};
+	astar_router_ptr_ = std::make_unique<TcAStarRouter>(route_graph_, std::move(lower_bound), landmarks_);
+}
+
+//Every vertex belongs to a stop: its wait and ride vertices or, in the route patterns model, the stop vertex
+//and the ride vertices boarded from it or left to it
+std::vector<std::string_view> RouteBuilder::GetVertexStops() const {
+	std::vector<std::string_view> vertex_stops(route_graph_.GetVertexCount());
+	for (const auto& [stop, vertices] : vertex_to_stop_) {
+		vertex_stops[vertices.first] = stop;
+		vertex_stops[vertices.second] = stop;
+	}
+	for (const auto& edge : route_graph_.GetEdges()) {
+		if (edge.weight.kind == EdgeKind::WAIT && vertex_stops[edge.to].empty()) {
+			vertex_stops[edge.to] = vertex_stops[edge.from];
+		}
+		else if (edge.weight.kind == EdgeKind::ALIGHT && vertex_stops[edge.from].empty()) {
+			vertex_stops[edge.from] = vertex_stops[edge.to];
+		}
+	}
+	return vertex_stops;
+}
+
+//Road distances may be shorter than the great-circle ones, so the bound is scaled by the smallest ratio of the two.
+//A ride sums road distances of consecutive stops, so it's never shorter than the scaled distance between its ends
+double RouteBuilder::GetRoadToGeoRatio(const TransportCatalogue& catalogue) const {
+	double ratio = std::numeric_limits<double>::infinity();
+	for (const auto& [stops, road_distance] : catalogue.GetDistances()) {
+		const double geo_distance = geo::ComputeDistance(stops.first->coordinates, stops.second->coordinates);
+		if (geo_distance > 0) {
+			ratio = std::min(ratio, road_distance / geo_distance);
+		}
+	}
+	//A margin for the rounding errors, the bound must never exceed a ride
+	return std::isinf(ratio) ? 0.0 : ratio * (1 - 1e-9);
+}
+
+//Restores the parts of a builder read from the database that are derived from the catalogue
+void RouteBuilder::PrepareForRequests(const TransportCatalogue& catalogue,
+	                                  const std::set<std::string_view>& route_names,
+	                                  const std::set<std::string_view>& stop_names) {
+	SetStopToVertexId(stop_names);
+	SetEdgeLabels(stop_names, route_names);
+	if (routing_settings_.router_type == RouterType::RAPTOR) {
+		BuildRaptorRouter(catalogue, route_names, stop_names);
+	}
+	if (routing_settings_.router_type == RouterType::ASTAR) {
+		BuildAStarRouter(catalogue);
 	}
 }
 
@@ -78,42 +366,234 @@ std::optional<RouteBuilder::RouteData> RouteBuilder::BuildRouteBetweenTwoStops(s
 	}
 	const auto [id_from, _] = vertex_to_stop_.at(stop_from);
 	const auto [id_to, __] = vertex_to_stop_.at(stop_to);
-	return router_ptr_->BuildRoute(id_from, id_to);
+	switch (routing_settings_.router_type) {
+	case RouterType::ALL_PAIRS:
+		return router_ptr_->BuildRoute(id_from, id_to);
+	case RouterType::DIJKSTRA:
+		return dijkstra_router_ptr_->BuildRoute(id_from, id_to);
+	case RouterType::CONTRACTION_HIERARCHIES:
+		return contraction_hierarchy_ptr_->BuildRoute(id_from, id_to);
+	case RouterType::RAPTOR:
+		break;
+	case RouterType::LAZY:
+		return lazy_router_ptr_->BuildRoute(id_from, id_to);
+	case RouterType::ASTAR:
+		return astar_router_ptr_->BuildRoute(id_from, id_to);
+	}
+	return {};
+}
+
+//Answers for repeated stop pairs, including the pairs with no route, come from the cache when it's on
+std::optional<RouteItinerary> RouteBuilder::BuildItinerary(std::string_view stop_from, std::string_view stop_to) const {
+	if (!route_cache_ptr_) {
+		return ComputeItinerary(stop_from, stop_to);
+	}
+	const auto stop_id_from = FindStopLabel(stop_from);
+	const auto stop_id_to = FindStopLabel(stop_to);
+	if (!stop_id_from || !stop_id_to) {
+		return {};
+	}
+	const uint64_t key = (static_cast<uint64_t>(*stop_id_from) << 32) | *stop_id_to;
+	if (auto cached_itinerary = route_cache_ptr_->Find(key)) {
+		return std::move(*cached_itinerary);
+	}
+	auto itinerary = ComputeItinerary(stop_from, stop_to);
+	route_cache_ptr_->Insert(key, itinerary);
+	return itinerary;
+}
+
+std::optional<RouteItinerary> RouteBuilder::ComputeItinerary(std::string_view stop_from, std::string_view stop_to) const {
+	if (routing_settings_.router_type != RouterType::RAPTOR) {
+		const auto route = BuildRouteBetweenTwoStops(stop_from, stop_to);
+		if (!route) {
+			return {};
+		}
+		return RouteItinerary{ route->weight.spend_time, GetRouteItems(*route) };
+	}
+	const auto stop_id_from = FindStopLabel(stop_from);
+	const auto stop_id_to = FindStopLabel(stop_to);
+	if (!stop_id_from || !stop_id_to) {
+		return {};
+	}
+	const auto route = raptor_router_ptr_->BuildRoute(*stop_id_from, *stop_id_to);
+	if (!route) {
+		return {};
+	}
+	RouteItinerary itinerary{ route->total_time, {} };
+	for (const auto& leg : route->legs) {
+		itinerary.items.push_back({ EdgeKind::WAIT, stop_labels_.at(leg.board_stop), 0,
+			                        static_cast<double>(routing_settings_.bus_wait_time_min) });
+		itinerary.items.push_back({ EdgeKind::BUS, bus_labels_.at(leg.route), leg.span_count, leg.ride_time });
+	}
+	return itinerary;
+}
+
+//With the routes matrix loaded or its rows computed lazily every cell is a route lookup, otherwise there is one
+//search per source stop: a one-to-all Dijkstra over the route graph or a RAPTOR search without a target.
+//A ride starts with a wait edge in both graph models, so the rides of a route are its wait edges
+TravelTimeMatrix RouteBuilder::BuildTravelTimeMatrix(const std::vector<std::string_view>& sources,
+	                                                 const std::vector<std::string_view>& targets) const {
+	TravelTimeMatrix matrix{ sources.size(), targets.size(),
+		                     std::vector<std::optional<double>>(sources.size() * targets.size()),
+		                     std::vector<int>(sources.size() * targets.size(), 0) };
+	const auto set_cell = [&matrix](size_t source_index, size_t target_index, double time, int rides) {
+		const size_t index = source_index * matrix.target_count + target_index;
+		matrix.times[index] = time;
+		matrix.transfers[index] = std::max(rides - 1, 0);
+	};
+
+	if (routing_settings_.router_type == RouterType::RAPTOR) {
+		for (size_t source_index = 0; source_index < sources.size(); ++source_index) {
+			const auto stop_from = FindStopLabel(sources[source_index]);
+			if (!stop_from) {
+				continue;
+			}
+			const auto arrivals = raptor_router_ptr_->BuildRoutesFrom(*stop_from);
+			for (size_t target_index = 0; target_index < targets.size(); ++target_index) {
+				const auto stop_to = FindStopLabel(targets[target_index]);
+				if (stop_to && arrivals[*stop_to].time) {
+					set_cell(source_index, target_index, *arrivals[*stop_to].time, arrivals[*stop_to].rides);
+				}
+			}
+		}
+		return matrix;
+	}
+
+	const auto count_rides = [this](const std::vector<graph::EdgeId>& edges) {
+		return static_cast<int>(std::count_if(edges.begin(), edges.end(), [this](graph::EdgeId edge_id) {
+			return route_graph_.GetEdge(edge_id).weight.kind == EdgeKind::WAIT;
+		}));
+	};
+	if (routing_settings_.router_type == RouterType::ALL_PAIRS || routing_settings_.router_type == RouterType::LAZY) {
+		for (size_t source_index = 0; source_index < sources.size(); ++source_index) {
+			for (size_t target_index = 0; target_index < targets.size(); ++target_index) {
+				if (const auto route = BuildRouteBetweenTwoStops(sources[source_index], targets[target_index])) {
+					set_cell(source_index, target_index, route->weight.spend_time, count_rides(route->edges));
+				}
+			}
+		}
+		return matrix;
+	}
+
+	//Edge weights were checked when the base was made
+	TcDijkstraRouter router;
+	router.SetGraph(route_graph_);
+	for (size_t source_index = 0; source_index < sources.size(); ++source_index) {
+		if (!vertex_to_stop_.count(sources[source_index])) {
+			continue;
+		}
+		const auto tree = router.BuildRoutesFrom(vertex_to_stop_.at(sources[source_index]).first);
+		for (size_t target_index = 0; target_index < targets.size(); ++target_index) {
+			if (!vertex_to_stop_.count(targets[target_index])) {
+				continue;
+			}
+			const VertexId vertex_to = vertex_to_stop_.at(targets[target_index]).first;
+			if (!tree.weights[vertex_to]) {
+				continue;
+			}
+			int rides = 0;
+			for (auto edge_id = tree.prev_edges[vertex_to]; edge_id; edge_id = tree.prev_edges[route_graph_.GetEdge(*edge_id).from]) {
+				rides += route_graph_.GetEdge(*edge_id).weight.kind == EdgeKind::WAIT ? 1 : 0;
+			}
+			set_cell(source_index, target_index, tree.weights[vertex_to]->spend_time, rides);
+		}
+	}
+	return matrix;
+}
+
+//A single search bounded by the time budget: from the stop or, for arrive-by queries, back to it over the
+//transposed graph. Stops come in the order of their route times
+std::optional<std::vector<IsochroneStop>> RouteBuilder::BuildIsochrone(std::string_view stop, double max_time,
+	                                                                   bool is_arrive_by) const {
+	std::vector<IsochroneStop> stops;
+	if (routing_settings_.router_type == RouterType::RAPTOR) {
+		const auto stop_id = FindStopLabel(stop);
+		if (!stop_id) {
+			return {};
+		}
+		const auto arrivals = is_arrive_by ? raptor_router_ptr_->BuildRoutesTo(*stop_id)
+			                               : raptor_router_ptr_->BuildRoutesFrom(*stop_id);
+		for (uint32_t id = 0; id < arrivals.size(); ++id) {
+			if (arrivals[id].time && *arrivals[id].time <= max_time) {
+				stops.push_back({ stop_labels_.at(id), *arrivals[id].time });
+			}
+		}
+	}
+	else {
+		if (!vertex_to_stop_.count(stop)) {
+			return {};
+		}
+		//Edge weights were checked when the base was made
+		TcDijkstraRouter router;
+		router.SetGraph(route_graph_);
+		const auto tree = router.BuildRoutesWithin(vertex_to_stop_.at(stop).first,
+			                                       graph::WeightTraits<EdgeWeight>::FromComparable(max_time), is_arrive_by);
+		for (const auto stop_name : stop_labels_) {
+			if (const auto& weight = tree.weights[vertex_to_stop_.at(stop_name).first]) {
+				stops.push_back({ stop_name, weight->spend_time });
+			}
+		}
+	}
+	std::stable_sort(stops.begin(), stops.end(), [](const IsochroneStop& lhs, const IsochroneStop& rhs) {
+		return lhs.time < rhs.time;
+	});
+	return stops;
+}
+
+//Merges consecutive ride edges of the route patterns model into one bus item and drops alighting edges
+std::vector<RouteItem> RouteBuilder::GetRouteItems(const RouteData& route) const {
+	std::vector<RouteItem> items;
+	EdgeKind prev_kind = EdgeKind::ALIGHT;
+	for (const auto edge_id : route.edges) {
+		const EdgeWeight& weight = route_graph_.GetEdge(edge_id).weight;
+		if (weight.kind == EdgeKind::BUS && prev_kind == EdgeKind::BUS) {
+			items.back().span_count += weight.span_count;
+			items.back().time += weight.spend_time;
+		}
+		else if (weight.kind != EdgeKind::ALIGHT) {
+			items.push_back({ weight.kind, GetEdgeLabel(weight), weight.span_count, weight.spend_time });
+		}
+		prev_kind = weight.kind;
+	}
+	return items;
 }
 
 void RouteBuilder::BuildSubgraphForStops(const std::set<std::string_view>& stop_names) {
 	VertexId id = 0;
+	uint32_t stop_label = 0;
 	for (const auto stop : stop_names) {
 		vertex_to_stop_[stop] = { id, (id + 1) };
-		route_graph_.AddEdge(GetStopEdge(id, (id + 1), std::string(stop)));
+		route_graph_.AddEdge(GetStopEdge(id, (id + 1), stop_label++));
 		id += 2;
 	}
 }
 
 void RouteBuilder::BuildSubgraphForRoutes(const TransportCatalogue& catalogue, 
 	                                      const std::set<std::string_view>& route_names) {
+	uint32_t route_label = 0;
 	for (const auto route : route_names) {
 		const auto& [route_stops, route_type] = catalogue.FindBus(route);
 		switch (route_type) {
 		case RouteType::LINER_ROUTE:
-			BuildSubgraphForLinerRoute(catalogue, route_stops, std::string(route));
+			BuildSubgraphForLinerRoute(catalogue, route_stops, route_label);
 			break;
 		case RouteType::RING_ROUTE:
-			BuildSubgraphForRingRoute(catalogue, route_stops, std::string(route));
+			BuildSubgraphForRingRoute(catalogue, route_stops, route_label);
 			break;
 		}
+		++route_label;
 	}
 }
 
 void RouteBuilder::BuildSubgraphForLinerRoute(const TransportCatalogue& catalogue,
 	                                          std::vector<Stop*>* route_stops, 
-	                                          const std::string& route_name) {
-	BuildSubgraphForLinerRouteInDirection(catalogue, false, route_stops, route_name);
-	BuildSubgraphForLinerRouteInDirection(catalogue, true, route_stops, route_name);
+	                                          uint32_t route_label) {
+	BuildSubgraphForLinerRouteInDirection(catalogue, false, route_stops, route_label);
+	BuildSubgraphForLinerRouteInDirection(catalogue, true, route_stops, route_label);
 }
 
 void RouteBuilder::BuildSubgraphForLinerRouteInDirection(const TransportCatalogue& catalogue, bool is_reverse,
-	                                                     std::vector<Stop*>* route_stops, const std::string& route_name) {
+	                                                     std::vector<Stop*>* route_stops, uint32_t route_label) {
 	size_t total_stops_count = route_stops->size();
 	size_t start_val, end_val, inc;
 	if (is_reverse) {
@@ -127,21 +607,21 @@ void RouteBuilder::BuildSubgraphForLinerRouteInDirection(const TransportCatalogu
 		inc = 1;
 	}
 	for (size_t from = start_val; from != end_val; from += inc) {
-		EdgeWeight total_weight = {};
+		EdgeWeight total_weight = { 0.0, 0, route_label, EdgeKind::BUS };
 		const auto [_, id_from_ride] = vertex_to_stop_.at(route_stops->at(from)->stop_name);
 		for (size_t to = from + inc; to != end_val; to += inc) {
 			if (std::abs(static_cast<int>(from - to)) != 1) {
 				const auto [id_to_wait, _] = vertex_to_stop_.at(route_stops->at(to)->stop_name);
 				double distance = catalogue.GetDistanceBetweenTwoStops(route_stops->at(to - inc),
 					                                                   route_stops->at(to));
-				total_weight += GetRouteEdgeWeight(distance, route_name);
+				total_weight += GetRouteEdgeWeight(distance, route_label);
 				route_graph_.AddEdge({ id_from_ride, id_to_wait, total_weight });
 			}
 			else {
 				const auto [id_to_wait, _] = vertex_to_stop_.at(route_stops->at(to)->stop_name);
 				double distance = catalogue.GetDistanceBetweenTwoStops(route_stops->at(from),
 					                                                   route_stops->at(to));
-				total_weight += GetRouteEdgeWeight(distance, route_name);
+				total_weight += GetRouteEdgeWeight(distance, route_label);
 				route_graph_.AddEdge({ id_from_ride, id_to_wait, total_weight });
 			}
 		}
@@ -150,37 +630,116 @@ void RouteBuilder::BuildSubgraphForLinerRouteInDirection(const TransportCatalogu
 
 void RouteBuilder::BuildSubgraphForRingRoute(const TransportCatalogue& catalogue,
 	                                         std::vector<Stop*>* route_stops, 
-	                                         const std::string& route_name) {
+	                                         uint32_t route_label) {
 	size_t total_stops_count = route_stops->size();
 	for (size_t from = 0; from < total_stops_count; ++from) {
-		EdgeWeight total_weight = {};
+		EdgeWeight total_weight = { 0.0, 0, route_label, EdgeKind::BUS };
 		const auto [_, id_from_ride] = vertex_to_stop_.at(route_stops->at(from)->stop_name);
 		for (size_t to = from + 1; to < total_stops_count; ++to) {
 			if (std::abs(static_cast<int>(from - to)) != 1) {
 				const auto [id_to_wait, _] = vertex_to_stop_.at(route_stops->at(to)->stop_name);
 			    double distance = catalogue.GetDistanceBetweenTwoStops(route_stops->at(to - 1),
 				                                                       route_stops->at(to));
-			    total_weight += GetRouteEdgeWeight(distance, route_name);
+			    total_weight += GetRouteEdgeWeight(distance, route_label);
 			    route_graph_.AddEdge({ id_from_ride, id_to_wait, total_weight });
 			}
 			else {
 				const auto [id_to_wait, _] = vertex_to_stop_.at(route_stops->at(to)->stop_name);
 				double distance = catalogue.GetDistanceBetweenTwoStops(route_stops->at(from),
 					                                                   route_stops->at(to));
-				total_weight += GetRouteEdgeWeight(distance, route_name);
+				total_weight += GetRouteEdgeWeight(distance, route_label);
 				route_graph_.AddEdge({ id_from_ride, id_to_wait, total_weight });
 			}
 		}
 	}
 }
 
-RouteBuilder::RouteEdge RouteBuilder::GetStopEdge(VertexId from, VertexId to, const std::string& type) const {
-	EdgeWeight stop_weight = { static_cast<double>(routing_settings_.bus_wait_time_min), 0, type };
+void RouteBuilder::BuildRoutePatterns(const TransportCatalogue& catalogue,
+	                                  const std::set<std::string_view>& route_names) {
+	uint32_t route_label = 0;
+	for (const auto route : route_names) {
+		const auto& [route_stops, route_type] = catalogue.FindBus(route);
+		BuildRoutePattern(catalogue, *route_stops, route_label);
+		if (route_type == RouteType::LINER_ROUTE) {
+			const std::vector<Stop*> reverse_stops(route_stops->rbegin(), route_stops->rend());
+			BuildRoutePattern(catalogue, reverse_stops, route_label);
+		}
+		++route_label;
+	}
+}
+
+//Adds a ride vertex per stop of one bus direction: boarding edges from the stop vertices, ride edges
+//between consecutive ride vertices and alighting edges back to the stop vertices
+void RouteBuilder::BuildRoutePattern(const TransportCatalogue& catalogue,
+	                                 const std::vector<Stop*>& pattern_stops,
+	                                 uint32_t route_label) {
+	const size_t stops_count = pattern_stops.size();
+	VertexId prev_ride_vertex = 0;
+	for (size_t index = 0; index < stops_count; ++index) {
+		const VertexId stop_vertex = vertex_to_stop_.at(pattern_stops[index]->stop_name).first;
+		const VertexId ride_vertex = route_graph_.AddVertex();
+		if (index + 1 < stops_count) {
+			//Stop vertices are numbered in the order of stop labels
+			route_graph_.AddEdge(GetStopEdge(stop_vertex, ride_vertex, static_cast<uint32_t>(stop_vertex)));
+		}
+		if (index > 0) {
+			double distance = catalogue.GetDistanceBetweenTwoStops(pattern_stops[index - 1], pattern_stops[index]);
+			route_graph_.AddEdge({ prev_ride_vertex, ride_vertex, GetRouteEdgeWeight(distance, route_label) });
+			route_graph_.AddEdge({ ride_vertex, stop_vertex, { 0.0, 0, route_label, EdgeKind::ALIGHT } });
+		}
+		prev_ride_vertex = ride_vertex;
+	}
+}
+
+//Vertices are sorted by the Hilbert index of their stops over the bounding box of all stops.
+//The sort is stable, so the vertices of one stop stay together in their former order
+void RouteBuilder::RenumberVertices(const TransportCatalogue& catalogue) {
+	const std::vector<std::string_view> vertex_stops = GetVertexStops();
+	const size_t vertex_count = vertex_stops.size();
+	double min_lat = std::numeric_limits<double>::max(), max_lat = std::numeric_limits<double>::lowest();
+	double min_lng = std::numeric_limits<double>::max(), max_lng = std::numeric_limits<double>::lowest();
+	for (const auto& stop : catalogue.GetStops()) {
+		min_lat = std::min(min_lat, stop.coordinates.lat);
+		max_lat = std::max(max_lat, stop.coordinates.lat);
+		min_lng = std::min(min_lng, stop.coordinates.lng);
+		max_lng = std::max(max_lng, stop.coordinates.lng);
+	}
+	const auto to_cell = [](double value, double min_value, double max_value) {
+		const double max_cell = static_cast<double>((1u << HILBERT_ORDER) - 1);
+		return max_value > min_value ? static_cast<uint32_t>((value - min_value) / (max_value - min_value) * max_cell) : 0u;
+	};
+	std::vector<uint64_t> keys(vertex_count, std::numeric_limits<uint64_t>::max());
+	for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+		if (!vertex_stops[vertex].empty()) {
+			const geo::Coordinates coordinates = catalogue.FindStop(vertex_stops[vertex])->coordinates;
+			keys[vertex] = GetHilbertIndex(to_cell(coordinates.lat, min_lat, max_lat), to_cell(coordinates.lng, min_lng, max_lng));
+		}
+	}
+	std::vector<VertexId> vertices(vertex_count);
+	std::iota(vertices.begin(), vertices.end(), 0);
+	std::stable_sort(vertices.begin(), vertices.end(), [&keys](VertexId lhs, VertexId rhs) {
+		return keys[lhs] < keys[rhs];
+	});
+	vertex_order_.assign(vertex_count, 0);
+	for (VertexId new_id = 0; new_id < vertex_count; ++new_id) {
+		vertex_order_[vertices[new_id]] = new_id;
+	}
+
+	RouteGraph renumbered_graph(vertex_count);
+	for (const auto& edge : route_graph_.GetEdges()) {
+		renumbered_graph.AddEdge({ vertex_order_[edge.from], vertex_order_[edge.to], edge.weight });
+	}
+	route_graph_ = std::move(renumbered_graph);
+	ApplyVertexOrder();
+}
+
+RouteBuilder::RouteEdge RouteBuilder::GetStopEdge(VertexId from, VertexId to, uint32_t stop_label) const {
+	EdgeWeight stop_weight = { static_cast<double>(routing_settings_.bus_wait_time_min), 0, stop_label, EdgeKind::WAIT };
 	return { from, to, stop_weight };
 }
 
-EdgeWeight RouteBuilder::GetRouteEdgeWeight(double distance, const std::string& type) const {
-	return { CalculateTime(distance, routing_settings_.bus_velocity_kmph), 1, type };
+EdgeWeight RouteBuilder::GetRouteEdgeWeight(double distance, uint32_t route_label) const {
+	return { CalculateTime(distance, routing_settings_.bus_velocity_kmph), 1, route_label, EdgeKind::BUS };
 }
 
 double CalculateTime(double distance_m, double speed_kmph) {
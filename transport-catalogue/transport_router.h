@@ -1,25 +1,71 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <memory>
 #include <utility>
 #include <string>
 #include <string_view>
+#include <tuple>
+#include <map>
 #include <set>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "transport_catalogue.h"
 #include "graph.h"
 #include "router.h"
+#include "dijkstra_router.h"
+#include "contraction_hierarchy.h"
+#include "raptor_router.h"
+#include "astar_router.h"
+#include "lru_cache.h"
+
+enum class RouterType {
+	ALL_PAIRS,
+	DIJKSTRA,
+	CONTRACTION_HIERARCHIES,
+	RAPTOR, // round-based search over bus stop sequences, no graph is built
+	LAZY, // routes from a vertex are computed on its first query and kept within a memory budget
+	ASTAR, // bidirectional A* guided by the distance between stops and optional landmarks
+};
+
+// STOP_PAIRS: a wait and a ride vertex per stop, every bus links each stop with all its later stops (O(n^2) edges per bus).
+// ROUTE_PATTERNS: a vertex per stop plus a ride vertex per stop of every bus direction, chained stop to stop (O(n) edges)
+enum class GraphModel {
+	STOP_PAIRS,
+	ROUTE_PATTERNS,
+};
+
+// ALPHABETICAL: vertices follow the stop names. HILBERT: vertices are renumbered along a Hilbert curve
+// over the stop coordinates, so nearby stops get close ids and searches touch close memory
+enum class VertexOrder {
+	ALPHABETICAL,
+	HILBERT,
+};
 
 struct RoutingSettings {
 
 	int bus_wait_time_min = 0;
 	double bus_velocity_kmph = {};
+	RouterType router_type = RouterType::ALL_PAIRS;
+	GraphModel graph_model = GraphModel::STOP_PAIRS;
+	VertexOrder vertex_order = VertexOrder::ALPHABETICAL;
+	size_t route_cache_size = 0; // finished itineraries kept for repeated stop pairs, 0 turns the cache off
+	size_t lazy_router_memory_mb = 64;
+	size_t astar_landmarks = 0; // landmarks picked at make_base for the A* bounds, 0 leaves the geographic bound alone
 
 };
 
+enum class EdgeKind : uint8_t {
+	WAIT,
+	BUS,
+	ALIGHT, // leaving a bus in the route patterns model, takes no time
+};
+
 struct EdgeWeight {
 
 	EdgeWeight() = default;
@@ -32,7 +78,57 @@ struct EdgeWeight {
 
 	double spend_time = {};
 	int span_count = {};
-	std::string edge_type = {};
+	uint32_t label_id = {}; // index of the stop name for wait edges, of the bus name for bus edges
+	EdgeKind kind = EdgeKind::WAIT;
+};
+
+static_assert(std::is_trivially_copyable_v<EdgeWeight>);
+
+template <>
+struct graph::WeightTraits<EdgeWeight> {
+	using Comparable = double;
+
+	static double ToComparable(const EdgeWeight& weight) {
+		return weight.spend_time;
+	}
+
+	static EdgeWeight FromComparable(double spend_time) {
+		EdgeWeight weight;
+		weight.spend_time = spend_time;
+		return weight;
+	}
+
+	static constexpr double Infinity() {
+		return std::numeric_limits<double>::infinity();
+	}
+};
+
+// One item of a route answer: waiting at a stop or a ride on one bus over span_count stops
+struct RouteItem {
+	EdgeKind kind = EdgeKind::WAIT;
+	std::string_view name;
+	int span_count = 0;
+	double time = 0;
+};
+
+struct RouteItinerary {
+	double total_time = 0;
+	std::vector<RouteItem> items;
+};
+
+// Travel times from every source to every target stop in row-major order.
+// Unknown or unreachable pairs have no time; transfers count the changes of bus
+struct TravelTimeMatrix {
+	size_t source_count = 0;
+	size_t target_count = 0;
+	std::vector<std::optional<double>> times;
+	std::vector<int> transfers;
+};
+
+// Stop reached within the time budget of an isochrone and its route time
+struct IsochroneStop {
+	std::string_view name;
+	double time = 0;
 };
 
 class RouteBuilder {
@@ -43,6 +139,11 @@ public:
 	using RouteGraph = graph::DirectedWeightedGraph<EdgeWeight>;
 	using RouteData = graph::Router<EdgeWeight>::RouteInfo;
 	using TcRouter = graph::Router<EdgeWeight>;
+	using TcDijkstraRouter = graph::DijkstraRouter<EdgeWeight>;
+	using TcContractionHierarchy = graph::ContractionHierarchy<EdgeWeight>;
+	using TcLazyRouter = graph::LazyRouter<EdgeWeight>;
+	using TcAStarRouter = graph::BidirectionalAStarRouter<EdgeWeight>;
+	using RouteCache = ShardedLruCache<uint64_t, std::optional<RouteItinerary>>; // key: stop labels of both ends
 
 	RouteBuilder() = default;
 	RouteBuilder(size_t stops_count, RoutingSettings);
@@ -50,33 +151,81 @@ public:
 	const RouteGraph& BuildGraph(const TransportCatalogue&, 
 		                         const std::set<std::string_view>& route_names,
 		                         const std::set<std::string_view>& stop_names);
+	void BuildRouter();
+	void RepairRouter(const RouteBuilder& previous);
+	void BuildRaptorRouter(const TransportCatalogue&,
+		                   const std::set<std::string_view>& route_names,
+		                   const std::set<std::string_view>& stop_names);
+	void BuildAStarRouter(const TransportCatalogue&);
+	void PrepareForRequests(const TransportCatalogue&,
+		                    const std::set<std::string_view>& route_names,
+		                    const std::set<std::string_view>& stop_names);
 	std::optional<RouteData> BuildRouteBetweenTwoStops(std::string_view stop_from, std::string_view stop_to) const;
+	std::optional<RouteItinerary> BuildItinerary(std::string_view stop_from, std::string_view stop_to) const;
+	std::vector<RouteItem> GetRouteItems(const RouteData& route) const;
+	TravelTimeMatrix BuildTravelTimeMatrix(const std::vector<std::string_view>& sources,
+		                                   const std::vector<std::string_view>& targets) const;
+	std::optional<std::vector<IsochroneStop>> BuildIsochrone(std::string_view stop, double max_time, bool is_arrive_by) const;
 
 	void SetStopToVertexId(const std::set<std::string_view> stops);
+	void SetEdgeLabels(const std::set<std::string_view>& stop_names, const std::set<std::string_view>& route_names);
 	void SetRoutingSettings(const RoutingSettings& settings);
-	void SetGraph(const RouteGraph& graph);
+	void SetGraph(RouteGraph graph);
 	void SetRouter(std::unique_ptr<TcRouter>&& router);
+	void SetContractionHierarchy(std::unique_ptr<TcContractionHierarchy>&& hierarchy);
+	void SetLandmarks(TcAStarRouter::Landmarks landmarks);
+	void SetVertexOrder(std::vector<graph::VertexId> vertex_order);
+	void SetStorageOwner(std::shared_ptr<const void> owner);
 
 	const RouteGraph& GetRouteGraph() const;
 	RoutingSettings GetRoutingSettings() const;
+	std::string_view GetEdgeLabel(const EdgeWeight& weight) const;
 	const TcRouter& GetRouter() const;
+	bool HasRouter() const;
+	const TcContractionHierarchy& GetContractionHierarchy() const;
+	bool HasContractionHierarchy() const;
+	const TcAStarRouter::Landmarks& GetLandmarks() const;
+	const std::vector<graph::VertexId>& GetVertexOrder() const;
+	std::optional<VertexPair> FindStopVertices(std::string_view stop_name) const;
+	size_t GetSettledVertexCount() const;
+	RouteCache::Stats GetRouteCacheStats() const;
 
 private:
 
+	std::shared_ptr<const void> storage_owner_ = nullptr; // keeps the memory borrowed by the graph and the router, released last
 	RouteGraph route_graph_;
 	RoutingSettings routing_settings_;
 	std::unique_ptr<TcRouter> router_ptr_ = nullptr;
+	std::unique_ptr<TcDijkstraRouter> dijkstra_router_ptr_ = nullptr;
+	std::unique_ptr<TcContractionHierarchy> contraction_hierarchy_ptr_ = nullptr;
+	std::unique_ptr<RaptorRouter> raptor_router_ptr_ = nullptr;
+	std::unique_ptr<TcLazyRouter> lazy_router_ptr_ = nullptr;
+	std::unique_ptr<TcAStarRouter> astar_router_ptr_ = nullptr;
+	TcAStarRouter::Landmarks landmarks_;
+	std::unique_ptr<RouteCache> route_cache_ptr_ = nullptr;
 	std::unordered_map<std::string_view, VertexPair> vertex_to_stop_;
+	std::vector<graph::VertexId> vertex_order_; // new id of every vertex of the alphabetical numbering, empty if it's kept
+	std::vector<std::string_view> stop_labels_;
+	std::vector<std::string_view> bus_labels_;
 
 
 	void BuildSubgraphForStops(const std::set<std::string_view>& stop_names);
 	void BuildSubgraphForRoutes(const TransportCatalogue&, const std::set<std::string_view>& route_names);
-	void BuildSubgraphForLinerRoute(const TransportCatalogue&, std::vector<Stop*>* route_stops, const std::string& route_name);
-	void BuildSubgraphForLinerRouteInDirection(const TransportCatalogue&, bool is_reverse, std::vector<Stop*>* route_stops, const std::string& route_name);
-	void BuildSubgraphForRingRoute(const TransportCatalogue&, std::vector<Stop*>* route_stops, const std::string& route_name);
-
-	RouteEdge GetStopEdge(graph::VertexId from, graph::VertexId to, const std::string& type) const;
-	EdgeWeight GetRouteEdgeWeight(double distance, const std::string& type) const;
+	void BuildSubgraphForLinerRoute(const TransportCatalogue&, std::vector<Stop*>* route_stops, uint32_t route_label);
+	void BuildSubgraphForLinerRouteInDirection(const TransportCatalogue&, bool is_reverse, std::vector<Stop*>* route_stops, uint32_t route_label);
+	void BuildSubgraphForRingRoute(const TransportCatalogue&, std::vector<Stop*>* route_stops, uint32_t route_label);
+	void BuildRoutePatterns(const TransportCatalogue&, const std::set<std::string_view>& route_names);
+	void BuildRoutePattern(const TransportCatalogue&, const std::vector<Stop*>& pattern_stops, uint32_t route_label);
+	void RenumberVertices(const TransportCatalogue&);
+	void ApplyVertexOrder();
+
+	RouteEdge GetStopEdge(graph::VertexId from, graph::VertexId to, uint32_t stop_label) const;
+	EdgeWeight GetRouteEdgeWeight(double distance, uint32_t route_label) const;
+	std::optional<uint32_t> FindStopLabel(std::string_view stop_name) const;
+	std::vector<std::string_view> GetVertexStops() const;
+	double GetRoadToGeoRatio(const TransportCatalogue&) const;
+	std::optional<RouteItinerary> ComputeItinerary(std::string_view stop_from, std::string_view stop_to) const;
+	void ResetRouteCache();
 
 };
 